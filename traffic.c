@@ -1,5 +1,8 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <ctype.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -8,15 +11,253 @@
 #include <math.h>
 #include <limits.h>
 #include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <dirent.h>
 
+#ifndef TRAFFIC_SIM_ONLY
 #include <ugpio/ugpio.h>
+#include <linux/gpio.h>
+#include <sys/ioctl.h>
+#endif
+
+#define MAX_APPROACHES 8		//approaches one intersection can have
+#define MAX_PHASES 16			//phases in one signal cycle
+#define EVENT_SAMPLE 0			//read one sensor
+#define EVENT_DECISION 1		//ask the strategy whether the phase is over
+#define SAMPLE_QUEUE_SIZE 1024	//raw readings a sampler can get ahead of the control loop
+#define MEDIAN_WINDOW 5			//readings the detection median runs over; medianFilter is written for five
+#define DETECTOR_BLOCK 64		//readings filtered together
+#define TRACE_BLOCK_BYTES 4096	//encoded samples per trace block
+#define TRACE_BLOCKS 8			//blocks the control loop can fill ahead of the trace writer
+#define TRACE_RECORD_MAX 16		//longest encoded sample: tag byte and two varints
+#define NUM_WINDOWS 3			//rolling windows kept per approach in daemon mode
+#define WINDOW_BUCKETS 1440		//one-minute buckets kept, enough for the longest window
+#define OMEGA_MAX_CHIPS 4		//gpio character devices looked for, /dev/gpiochip0 upwards
+#define OMEGA_HANDLE_LINES 64	//lines one gpio line handle can hold
+#define LATENCY_SUB_BITS 4		//each power of two of a latency histogram is split into 16 buckets
+#define LATENCY_MAX_EXPONENT 40	//latencies of 2^41 ns (about 37 minutes) and more share the last bucket
+#define LATENCY_BUCKETS ((LATENCY_MAX_EXPONENT - LATENCY_SUB_BITS + 2) << LATENCY_SUB_BITS)
+#define LATENCY_READ_SENSOR 0	//one whole readSensor
+#define LATENCY_ECHO_WAIT 1		//one wait for an echo edge
+#define LATENCY_GPIO_WRITE 2	//one gpio value, or one batch of them, written
+#define LATENCY_PHASE_SWITCH 3	//all the lights of a phase change
+#define LATENCY_LOG_ENQUEUE 4	//one writeToLog that was not filtered out
+#define LATENCY_LOG_WRITE 5		//one batch formatted and flushed by the log writer
+#define LATENCY_JOURNAL_SYNC 6	//one group commit of the interval journal
+#define LATENCY_STAGES 7
+
+//time a stage into its latency histogram; -DTRAFFIC_NO_LATENCY compiles every probe out
+#ifndef TRAFFIC_NO_LATENCY
+#define LATENCY_START(start) long long start = latencyNow()
+#define LATENCY_RECORD(stage, start) recordLatency(&latencyStages[stage], latencyNow() - (start))
+#else
+#define LATENCY_START(start)
+#define LATENCY_RECORD(stage, start)
+#endif
+
+//-DTRAFFIC_FIXED_POINT keeps sensor ranges, interval times and cps as scaled integers, for CPUs without an
+//FPU such as the Omega2's MT7688: ranges in hundredths of a cm, times in milliseconds, cps in cars per
+//million seconds. Every stat it reports must match the float build within replayTolerance (1e-4 relative).
+//To check, replay one trace with both builds and diff the fixed run against the float one; it exits 1 on
+//any difference:
+//	float build:	traffic 0 0 replay <trace>				writes <prefix>_*.stat
+//	fixed build:	traffic 0 0 replay <trace> <prefix>		writes its own stats and a _DIFF.stat
+#ifdef TRAFFIC_FIXED_POINT
+typedef int32_t intervalTime;
+typedef int32_t intervalCPS;
+typedef int64_t intervalSum;		//sums of times or of cps over many intervals
+#define TIME_FROM_SECONDS(seconds) ((intervalTime)lroundf((seconds)*1000))
+#define TIME_TO_SECONDS(time) ((time)/1000.0f)
+#define CPS_TO_FLOAT(cps) ((cps)/1e6f)
+typedef int32_t sensorRange;		//hundredths of a cm, as the echo is timed and the trace stores it
+#define RANGE_FROM_CM(cm) ((sensorRange)lroundf((cm)*100))
+#define RANGE_TO_CM(range) ((range)/100.0f)
+#define RANGE_FROM_HUNDREDTHS(hundredths) ((sensorRange)(hundredths))
+#define RANGE_TO_HUNDREDTHS(range) ((long)(range))
+#else
+typedef float intervalTime;
+typedef float intervalCPS;
+typedef float intervalSum;
+#define TIME_FROM_SECONDS(seconds) (seconds)
+#define TIME_TO_SECONDS(time) (time)
+#define CPS_TO_FLOAT(cps) (cps)
+typedef float sensorRange;			//cm
+#define RANGE_FROM_CM(cm) (cm)
+#define RANGE_TO_CM(range) (range)
+#define RANGE_FROM_HUNDREDTHS(hundredths) ((hundredths)/100.0f)
+#define RANGE_TO_HUNDREDTHS(range) lroundf((range)*100)
+#endif
 
 //Stats Over The Interval (raw data)
 struct StatsOverInterval
 {
 	int numCars;
+	intervalTime timeInterval;
+	intervalCPS cps;
+	long long startTime;	//start of the interval on the backend clock, in nanoseconds
+};
+
+//Header of a *_RAW.rawbin file; each column follows as a packed array of count values
+struct RawBinaryHeader
+{
+	char magic[8];				//"TRAFRAW\0"
+	uint32_t version;
+	uint32_t count;				//number of intervals
+	char direction[16];
+	uint64_t startTimeOffset;	//int64 nanoseconds
+	uint64_t numCarsOffset;		//int32
+	uint64_t timeIntervalOffset;	//float
+	uint64_t cpsOffset;			//float
+};
+
+//First page of an interval journal; records start on the page after it
+struct JournalHeader
+{
+	char magic[8];				//"TRAFJRN\0"
+	uint32_t version;
+	uint32_t clean;				//set once the run that wrote it finished and wrote its stats
+	uint32_t numApproaches;
+	char names[MAX_APPROACHES][16];	//approach each record's index refers to
+};
+
+//One completed interval as appended to the journal
+struct JournalRecord
+{
+	uint32_t sequence;			//0 for the first record, one more for each after it
+	uint32_t checksum;			//FNV-1a of the record with this field zero; a torn write fails it
+	uint32_t approach;
+	int32_t numCars;
 	float timeInterval;
 	float cps;
+	int64_t startTime;
+};
+
+//Journal being appended to, one mapped chunk at a time
+struct Journal
+{
+	int fd;
+	struct JournalHeader *header;	//mapped first page
+	struct JournalRecord *chunk;	//mapped chunk the next record goes into
+	off_t chunkOffset;				//file offset of the chunk
+	int used;						//records already in the chunk
+	int synced;						//records of the chunk already flushed to disk
+	uint32_t sequence;				//sequence number of the next record
+	int syncEvery;					//records per group commit, 0 to flush only when closing
+	int recovered;					//records read back from an unfinished run
+	const char *path;				//to start the next journal when the output rotates
+};
+
+//Start of a raw sensor trace file; blocks of encoded samples follow it
+struct TraceHeader
+{
+	char magic[8];				//"TRAFTRC\0"
+	uint32_t version;
+	uint32_t numSensors;
+	uint32_t samplePeriod;		//microseconds, timestamps are stored relative to it
+	uint32_t reserved;
+	char names[MAX_APPROACHES][16];	//approach each sensor index belongs to
+};
+
+//Samples encoded in a trace file. The first sample of each sensor in a block is stored against zero,
+//so every block can be decoded on its own. Each sample is a tag byte (sensor index in the low three
+//bits, status above them: 0 range, 1 no echo, 2 no answer) followed by the zigzag varint of its
+//timestamp in microseconds less the previous one of the sensor plus the sample period, and, for a
+//range, the zigzag varint of the range in hundredths of a centimetre less the sensor's previous range.
+struct TraceBlock
+{
+	uint32_t magic;				//traceBlockMagic
+	uint32_t bytes;				//bytes of data used
+	uint32_t count;				//samples in the block
+	unsigned char data[TRACE_BLOCK_BYTES];
+};
+
+//Records every raw reading the controller takes in. The control loop only encodes into memory;
+//full blocks are passed through a ring to a writer thread, and dropped whole if it falls behind.
+struct TraceRecorder
+{
+	int fd;
+	struct TraceBlock blocks[TRACE_BLOCKS];
+	atomic_uint head;			//blocks handed to the writer
+	atomic_uint tail;			//blocks written out (writer thread only)
+	bool filling;				//blocks[head] is being filled
+	long long lastTime[MAX_APPROACHES];	//microseconds, per block
+	long lastRange[MAX_APPROACHES];		//hundredths of a centimetre, per block
+	unsigned long recorded;
+	atomic_ulong dropped;		//samples lost because no block was free or its write failed
+	bool lossless;				//wait for a free block instead of dropping (virtual time runs)
+	atomic_bool running;
+	pthread_t thread;
+};
+
+//Reads a trace file back one sample at a time
+struct TraceReader
+{
+	void *map;
+	size_t length;
+	const struct TraceHeader *header;
+	size_t offset;				//of the next block
+	struct TraceBlock block;	//copy of the one being decoded; blocks are packed, so not aligned in the file
+	uint32_t position;			//byte of the block's data to decode next
+	uint32_t remaining;			//samples left in the block
+	long long lastTime[MAX_APPROACHES];
+	long lastRange[MAX_APPROACHES];
+};
+
+//Intervals that ended within one minute of the backend clock
+struct WindowBucket
+{
+	long long minute;			//minute the bucket holds, -1 while unused
+	int intervals;
+	int cars;
+	float time;
+	double cps;
+	double cpsSquares;
+	int maxCars;
+	int minCars;
+	float maxCPS;
+	float minCPS;
+};
+
+//Totals of one sliding window
+struct WindowTotals
+{
+	long long from;				//oldest minute counted
+	int intervals;
+	long cars;
+	double time;
+	double cps;
+	double cpsSquares;
+};
+
+//Sliding windows over one approach's intervals. A ring of one-minute buckets covers the longest window
+//and each window keeps totals that gain every new interval and lose the buckets it slides past, so
+//memory and the work per interval stay the same however long the controller runs
+struct RollingWindows
+{
+	struct WindowBucket buckets[WINDOW_BUCKETS];
+	struct WindowTotals totals[NUM_WINDOWS];
+	long long minute;			//latest minute the windows end at
+};
+
+//A *_RAW.rawbin file mapped into memory; the column pointers point straight into the mapping
+struct RawBinaryView
+{
+	void *map;
+	size_t length;
+	const struct RawBinaryHeader *header;
+	const int64_t *startTime;
+	const int32_t *numCars;
+	const float *timeInterval;
+	const float *cps;
 };
 
 //Stats Over The Simulation (stats)
@@ -28,7 +269,7 @@ struct StatsOverSimulation
 	int minCars;
 	float averageCars;
 	float averageTime;
-	int modeCars[10000];
+	int *modeCars;			//numModes entries, freed with freeStatsOverSimulation
 	int numModes;
 	float maxCPS;
 	float minCPS;
@@ -39,6 +280,528 @@ struct StatsOverSimulation
 	float timeSaved;
 };
 
+//How a stats field is formatted
+enum StatFieldType
+{
+	STAT_INT,
+	STAT_FLOAT,
+	STAT_MODES				//int array of numModes entries
+};
+
+//One field of StatsOverSimulation; every stats report is written from the table of these
+struct StatField
+{
+	const char *label;		//text report line
+	const char *key;		//CSV column and JSON member
+	const char *unit;		//appended to the value in the text report
+	enum StatFieldType type;
+	size_t offset;			//offsetof in struct StatsOverSimulation
+};
+
+//Report formatted in memory and written out in as few writes as possible
+struct ReportBuffer
+{
+	char *data;
+	size_t length;
+	size_t capacity;
+	int fd;
+	bool ok;				//cleared by any failed open or write
+	char filename[200];
+};
+
+//One log message waiting to be written
+struct LogRecord
+{
+	int logMessageNumber;
+	char tag[48];
+	float value;
+};
+
+//Bounded ring buffer of log records drained by a background writer thread
+struct Logger
+{
+	struct LogRecord records[1024];
+	atomic_uint sequence[1024];		//per-slot turn counter so several threads can log at once
+	atomic_uint head;				//next slot to fill
+	unsigned int tail;				//next slot to write out (writer thread only)
+	atomic_ulong dropped;			//records lost because the ring was full
+	atomic_bool running;
+	bool lossless;					//wait for space instead of dropping (virtual time runs)
+	bool started;
+	FILE *file;
+	pthread_t thread;
+};
+
+//Raw interval data kept in fixed-size chunks so memory grows with the run instead of being reserved up front
+struct IntervalStore
+{
+	struct StatsOverInterval **chunks;
+	int numChunks;
+	int capacityChunks;
+	int size;
+	int maxSize;			//hard cap on stored intervals, 0 for none
+	int dropped;			//intervals refused once maxSize was reached
+	int spillFd;			//chunks are mmapped from this file when >= 0
+};
+
+//Running statistics updated as each interval completes, so the simulation stats are always current
+struct StatsAccumulator
+{
+	int count;
+	int totalCars;
+	int maxCars;
+	int minCars;
+	intervalCPS maxCPS;
+	intervalCPS minCPS;
+#ifdef TRAFFIC_FIXED_POINT
+	int64_t totalTime;
+	int64_t sumCPS;
+	uint64_t sumSquaresCPS;	//exact; overflows only after about 10^8 intervals at 0.3 cps
+#else
+	double totalTime;
+	double meanCPS;			//Welford running mean
+	double sumSquaresCPS;	//Welford sum of squared differences from the mean
+#endif
+	intervalCPS *lowerCPS;	//max-heap holding the smaller half of the cps values
+	int sizeLower;
+	intervalCPS *upperCPS;	//min-heap holding the larger half of the cps values
+	int sizeUpper;
+	int capacityCPS;
+	int *carCounts;			//histogram: number of intervals seen with each car count
+	int sizeCarCounts;
+	int maxFrequency;
+	int numModes;			//car counts that occur maxFrequency times
+};
+
+//One approach into the intersection with its pins and everything recorded for it
+struct Approach
+{
+	char name[16];
+	unsigned int greenPort;
+	unsigned int redPort;
+	unsigned int sensorIn;		//echo
+	unsigned int sensorOut;		//trigger
+	float arrivalRate;			//cars per second, used by the sim backend
+	int waiting;				//cars detected while red since the approach was last green
+	struct IntervalStore intervals;
+	struct StatsAccumulator stats;
+};
+
+//How closely a loop kept to its deadlines, in nanoseconds
+struct TimingStats
+{
+	long count;
+	long missed;				//iterations that started later than the budget allows
+	double meanLateness;		//running mean and sum of squared differences (Welford)
+	double m2Lateness;
+	long long maxLateness;
+};
+
+#ifndef TRAFFIC_NO_LATENCY
+//Log-linear histogram of one stage's latencies, in nanoseconds: exact below 16 ns, then 16 buckets per
+//power of two, so every recorded value is within 1/16 of its bucket. Any thread may record into it
+struct LatencyHistogram
+{
+	atomic_ulong counts[LATENCY_BUCKETS];
+	atomic_ulong total;
+	atomic_ullong sum;
+	atomic_llong max;
+};
+#endif
+
+//One raw reading taken by a sensor sampler
+struct RangeSample
+{
+	long long timestamp;		//backend clock, nanoseconds
+	sensorRange range;			//as readSensor returned it, including -1 and -2
+};
+
+//Lock-free single-producer single-consumer ring carrying one sampler's readings to the control loop
+struct SampleQueue
+{
+	struct RangeSample samples[SAMPLE_QUEUE_SIZE];
+	atomic_uint head;			//next slot the sampler fills
+	atomic_uint tail;			//next slot the control loop reads
+	atomic_uint dropped;		//readings lost because the control loop fell behind
+};
+
+//A vehicle arriving over a sensor or leaving it, after filtering
+struct VehicleEvent
+{
+	long long timestamp;		//backend clock, nanoseconds
+	bool arrival;				//false for a departure
+	float occupancy;			//seconds the vehicle was over the sensor, departures only
+};
+
+//Turns one sensor's raw readings into vehicle events: a median over the last MEDIAN_WINDOW readings
+//removes single bad echoes, then hysteresis between the enter and exit thresholds debounces the result
+struct Detector
+{
+	sensorRange enterThreshold;		//filtered range at or below which a vehicle arrives
+	sensorRange exitThreshold;		//filtered range above which it has left
+	sensorRange history[MEDIAN_WINDOW - 1];	//last readings of the previous block, oldest first
+	long long historyTime[MEDIAN_WINDOW - 1];
+	sensorRange lastValid;			//stands in for readings where the sensor didn't answer
+	bool occupied;
+	long long occupiedSince;
+	long noEchoes;				//readings with no echo (-1)
+	long timeouts;				//readings the sensor never answered (-2)
+};
+
+//Samples one approach's sensor, on its own thread or in its own slot of the control loop
+struct Sampler
+{
+	unsigned int sensorIn;
+	unsigned int sensorOut;
+	float threshold;
+	struct SampleQueue queue;
+	bool threaded;
+	atomic_bool running;
+	pthread_t thread;
+	struct Backend *backend;	//backend of the thread that started the sampler
+	struct TimingStats timing;	//written by the sampling thread, read once it has stopped
+};
+
+//One signal phase: the approaches that are green together and how long they may stay green
+struct Phase
+{
+	unsigned int greenMask;		//bit i set means approach i is green
+	float minGreen;				//seconds before gap-out is allowed
+	float maxGreen;				//seconds before the phase ends regardless of traffic
+	float gapOut;				//seconds without a car that end the phase early
+};
+
+//Approaches and phase sequence of one intersection, loaded at startup
+struct PhaseTable
+{
+	struct Approach approaches[MAX_APPROACHES];
+	int numApproaches;
+	struct Phase phases[MAX_PHASES];
+	int numPhases;
+};
+
+struct Controller;
+
+//Something the controller has to do at a given time
+struct Event
+{
+	long long time;		//backend clock, nanoseconds
+	int type;			//EVENT_SAMPLE or EVENT_DECISION
+	int index;			//sampler to read for EVENT_SAMPLE
+};
+
+//Binary min-heap of pending events, earliest first
+struct EventQueue
+{
+	struct Event *heap;
+	int size;
+	int capacity;
+};
+
+//Decides when the running phase ends and which phase follows it
+struct ControlStrategy
+{
+	const char *name;
+	void (*startPhase)(struct Controller *ctrl);	//may be NULL
+	bool (*phaseDone)(struct Controller *ctrl, float elapsed, float sinceLastCar, float *timeInterval);
+	long long (*nextDecision)(struct Controller *ctrl);	//when phaseDone could next turn true without new cars
+	int (*nextPhase)(struct Controller *ctrl);
+};
+
+//State of one intersection's controller between ticks of the control loop
+struct Controller
+{
+	struct PhaseTable *table;
+	const struct ControlStrategy *strategy;
+	struct Sampler *samplers;
+	bool threadedSampling;
+	int currentPhase;
+	bool phaseActive;
+	long long timerMain;			//start of the running phase, backend clock nanoseconds
+	long long timerOpti;			//last car seen on a green approach
+	int carCounter[MAX_APPROACHES];	//cars seen on each green approach this phase
+	float demand[MAX_APPROACHES];	//estimated cars queued on each approach
+	int arrivals[MAX_APPROACHES];	//cars seen on each approach since the run started
+	float lastCPS[MAX_APPROACHES];	//cars per second of each approach's last green interval
+	struct Journal *journal;		//where completed intervals are made durable, NULL for none
+	struct RollingWindows *windows;	//one per approach in daemon mode, NULL otherwise
+	struct TraceRecorder *trace;	//where raw readings are recorded, NULL for none
+	long long runStart;
+	float greenTarget;				//green time chosen for the running phase by split-based strategies
+	long long lastDemandUpdate;		//when demand last discharged
+	struct EventQueue events;		//samples and decisions still to come
+	struct TimingStats timing;		//how late events were handled
+	struct Detector detectors[MAX_APPROACHES];	//turn each sampler's readings into vehicles
+	long long deadline;				//the pending decision; decision events at other times are stale
+	struct MetricsSegment *metrics;	//live counters for monitors, NULL when not published
+};
+
+//Live counters of one approach, as published for monitors
+struct MetricsApproach
+{
+	char name[16];
+	int cars;					//cars seen since the run started
+	int carsThisGreen;			//cars seen during the running phase, 0 while red
+	float lastCPS;				//cars per second of the last completed green interval
+	long noEchoes;
+	long timeouts;
+	unsigned int samplesDropped;
+};
+
+//What a monitor copies out of the segment in one go
+struct Metrics
+{
+	long long updated;			//CLOCK_MONOTONIC nanoseconds of the last publish
+	int numApproaches;
+	int phase;					//running phase, -1 once the controller has stopped
+	unsigned int greenMask;
+	float phaseElapsed;			//seconds the running phase has been green
+	struct MetricsApproach approaches[MAX_APPROACHES];
+	long events;				//controller events handled
+	long missed;				//of which later than the lateness budget
+	double meanLateness;		//nanoseconds
+	double jitter;				//standard deviation of the lateness, nanoseconds
+	long long maxLateness;
+	unsigned long logDropped;
+};
+
+//Memory-mapped file the controller publishes its counters to. A seqlock guards the data: the
+//controller makes the sequence odd while it writes and readers retry whenever it was odd or changed
+//while they copied, so neither side ever takes a lock or makes a system call
+struct MetricsSegment
+{
+	unsigned int magic;
+	unsigned int version;
+	int pid;
+	atomic_uint sequence;
+	struct Metrics data;
+};
+
+//Backend behind the LED, sensor and clock functions (Omega GPIO or simulation)
+struct Backend
+{
+	const char *name;
+	void *state;
+	bool virtualTime;				//clock only advances when the controller sleeps
+	void (*requestPin)(struct Backend *self, const unsigned int port, bool output);
+	bool (*holdPins)(struct Backend *self);	//takes every requested output at once after the last requestPin, may be NULL
+	void (*setValue)(struct Backend *self, const unsigned int port, int value);
+	void (*setValues)(struct Backend *self, const unsigned int ports[], const int values[], int count);	//in one write per chip, may be NULL
+	int (*getValue)(struct Backend *self, const unsigned int port);
+	long long (*now)(struct Backend *self);							//monotonic time in nanoseconds
+	void (*sleepMicro)(struct Backend *self, unsigned int microseconds);
+	void (*sleepUntil)(struct Backend *self, long long time);	//absolute backend clock time, may be NULL
+	sensorRange (*readRange)(struct Backend *self, const unsigned int gpioIn, const unsigned int gpioOut);	//NULL times the echo over gpio
+	bool (*armEdge)(struct Backend *self, const unsigned int port);	//NULL or false polls the echo pin instead
+	bool (*waitEdge)(struct Backend *self, const unsigned int port, int level, long long timeout, long long *timestamp);
+	void (*addApproach)(struct Backend *self, const unsigned int gpioIn, const unsigned int greenPort, float arrivalRate);
+	void (*report)(struct Backend *self, struct ReportBuffer *report);	//ground truth the backend knows, may be NULL
+	long long (*nextChange)(struct Backend *self, const unsigned int gpioIn);	//earliest time a sensor reading can change, may be NULL
+};
+
+//One gpio character device; its output lines share one line handle so they can be written together
+struct OmegaChip
+{
+	int fd;						//the open /dev/gpiochipN
+	unsigned int base;			//gpio number of its line 0
+	unsigned int lines;
+	int handleFd;				//line handle of all its outputs, -1 until the backend holds its pins
+	pthread_mutex_t lock;		//samplers' triggers and the lights write the same handle
+	int numOutputs;
+	unsigned int outputs[OMEGA_HANDLE_LINES];	//line offsets in handle order
+	unsigned char values[OMEGA_HANDLE_LINES];	//last value written to each
+};
+
+//State of the Omega backend
+struct OmegaState
+{
+	int valueFd[64];			//sysfs value file per gpio for edge events; -1 unopened, -2 unsupported
+	bool chardev;				//lines are held through /dev/gpiochip* handles instead of sysfs
+	struct OmegaChip chips[OMEGA_MAX_CHIPS];
+	int numChips;
+	int outputSlot[64];			//index of each output among its chip's outputs, -1 for none
+	int inputFd[64];			//line event (or plain input) handle of each input, -1 for none
+	bool inputEdges[64];		//inputFd delivers edge events
+};
+
+//One simulated approach: cars arrive at random past an advance sensor, queue on red and leave on green
+struct SimApproach
+{
+	unsigned int gpioIn;
+	unsigned int greenPort;
+	double arrivalRate;			//cars per second
+	int queue;					//cars waiting at the stop line
+	long long nextArrival;		//virtual time of the next arrival
+	long long nextDeparture;	//earliest virtual time the next queued car can cross
+	long long occupiedFrom;		//virtual time the last arriving car reached the sensor
+	float carRange;				//range in cm the last arriving car reads, cars differ in height
+	int departed;				//cars that have left through the intersection
+	double delay;				//seconds cars spent queued, summed over all cars
+	long long lastQueueChange;	//virtual time delay was last accumulated up to
+	long long *inbound;			//arrival times handed over from an upstream intersection, oldest first
+	int inboundHead;
+	int inboundSize;
+	int inboundCapacity;
+	long long *outbound;		//departure times kept for a downstream intersection, NULL when not wanted
+	int outboundSize;
+	int outboundCapacity;
+};
+
+#ifdef TRAFFIC_BENCH
+//State of the mocked GPIO used to benchmark readSensor: an HC-SR04 that always sees the same range
+struct MockState
+{
+	long long clock;		//virtual nanoseconds; advanced by sleeps and clock reads
+	long long echoRise;		//when the echo pin goes high after the last trigger
+	long long echoFall;		//when it goes low again
+	float range;			//centimeters the mocked sensor reports
+};
+#endif
+
+//State of the simulated backend
+struct SimState
+{
+	long long clock;			//virtual time in nanoseconds
+	unsigned int seed;
+	unsigned int noiseSeed;		//kept apart from seed so noise does not change the arrivals
+	int pins[64];
+	struct SimApproach approaches[MAX_APPROACHES];
+	int numApproaches;
+};
+
+//Every reading one sensor of a replayed trace recorded, oldest first
+struct ReplaySensor
+{
+	char name[16];				//approach the sensor belongs to
+	unsigned int gpioIn;		//pin the approach reads it through, set by addApproach
+	long long *times;			//backend clock of each reading, nanoseconds
+	sensorRange *ranges;
+	int *nextChange;			//index of the next reading with a different range, count when there is none
+	int count;
+	int capacity;
+	int cursor;					//last reading at or before the clock
+};
+
+//State of the replay backend: recorded readings played back on a virtual clock
+struct ReplayState
+{
+	long long clock;			//virtual time in nanoseconds, on the recording's clock
+	int pins[64];
+	struct ReplaySensor sensors[MAX_APPROACHES];	//in table order once replayBindTable has run
+	int numSensors;
+	int numApproaches;			//added so far; approach i reads sensor i
+	long long start;			//clock the replay starts at
+	long long end;				//time of the last reading of any sensor
+	unsigned long readings;
+};
+
+//Cars on their way from one corridor intersection to the next
+struct CorridorLink
+{
+	long long *times;			//virtual time each car reaches the downstream intersection
+	int size;
+	int capacity;
+};
+
+//One simulated intersection with everything it owns, as a corridor node or a sweep candidate
+struct SimIntersection
+{
+	struct Backend *backend;
+	struct PhaseTable table;
+	struct Controller controller;
+	struct Sampler samplers[MAX_APPROACHES];
+	struct CorridorLink outbox[2];	//written in even/odd epochs, read by the next node one epoch later
+	unsigned int turnSeed;			//decides which departing cars leave the corridor
+};
+
+//Nodes a worker still has to run this epoch, packed as (first << 32 | end) so owner and thieves agree with one CAS
+struct WorkRange
+{
+	_Atomic uint64_t range;
+	char pad[56];				//one range per cache line
+};
+
+//Many intersections advanced together in epochs of one link travel time
+struct Corridor
+{
+	struct SimIntersection *nodes;
+	int numNodes;
+	int numEpochs;
+	int numWorkers;
+	struct WorkRange *ranges;
+	pthread_barrier_t barrier;
+	atomic_long steals;
+};
+
+//One worker thread of the corridor simulator
+struct CorridorWorker
+{
+	struct Corridor *corridor;
+	int id;
+	pthread_t thread;
+};
+
+//One timing plan tried by the sweep and how it did
+struct SweepCandidate
+{
+	float maxGreen;
+	float gapOut;
+	float threshold;
+	float timeSaved;		//summed over approaches, per simulated second
+	float avgCPS;			//averaged over approaches
+	float varianceCPS;		//population variance of cps, averaged over approaches
+	double averageDelay;	//seconds per car, from the simulation's ground truth
+};
+
+//Candidates shared by the sweep workers, handed out in order
+struct Sweep
+{
+	struct SweepCandidate *candidates;
+	int numCandidates;
+	atomic_int next;
+	struct PhaseTable *table;
+	const struct ControlStrategy *strategy;
+	int simulationTime;
+	unsigned int seed;
+};
+
+//Stats of one approach name merged across every run an aggregation read
+struct AggregateApproach
+{
+	char name[16];
+	int files;
+	struct StatsAccumulator stats;
+};
+
+//What one aggregation worker has read; the workers' partials are merged once all files are done
+struct AggregatePartial
+{
+	struct AggregateApproach *approaches;
+	int numApproaches;
+	int capacity;
+	int files;
+	int failed;				//files that could not be read or held no data
+	char strategy[32];		//from the *_SIM.stat files, "mixed" when runs differ
+};
+
+//Run output files shared by the aggregation workers, handed out in order
+struct Aggregation
+{
+	char **paths;
+	int numPaths;
+	int capacity;
+	atomic_int next;
+	int statOnly;			//*_SIM.stat files with no raw file next to them
+};
+
+//One worker thread of the aggregation
+struct AggregateWorker
+{
+	struct Aggregation *aggregation;
+	struct AggregatePartial partial;
+	pthread_t thread;
+};
+
 //Constants
 const unsigned int GRN_N = 18;          //gpio slot of green led for north
 const unsigned int RED_N = 46;          //gpio slot of red led for north
@@ -50,27 +813,272 @@ const unsigned int SENS_W_IN = 0;       //input (echo) gpio slot of sensor for w
 const unsigned int SENS_W_OUT = 11;     // output (trigger) gpio slot of sensor for west
 
 const float defaultTimeInterval = 30;   //default time interval to switch from green to red
-const float defaultThreshold = 0.3;		//threshold for the sensor
+const float defaultThreshold = 0.3;		//range in cm below which the sensor sees a car
+const long long echoStartTimeout = 25000000;	//ns to wait for the echo to start before the sensor counts as failed
+const long long echoMaxWidth = 32000000;		//ns of echo meaning nothing was detected
+
+const int intervalChunkBytes = 16384;		//bytes per interval store chunk (multiple of the page size for spilling)
+const int journalPageBytes = 4096;			//bytes of the journal header page, records follow it
+const int journalChunkBytes = 65536;		//bytes the journal grows and is mapped by (multiple of the page size)
+const int defaultJournalSync = 4;			//intervals per journal group commit unless TRAFFIC_JOURNAL_SYNC says otherwise
+const uint32_t traceBlockMagic = 0x42435254;	//"TRCB", starts every trace block
+const int windowMinutes[NUM_WINDOWS] = {15, 60, 1440};		//length of each rolling window
+const char *windowNames[NUM_WINDOWS] = {"Last 15 min", "Last 1 h", "Last 24 h"};
+
+volatile sig_atomic_t stopRequested = 0;	//set by SIGTERM or SIGINT; a daemon finishes its files and exits
+
+const float defaultGapOut = 10;			//default seconds without a car before switching early
+const unsigned int samplePeriod = 100000;	//microseconds between samples of each sensor
+const long long latenessBudget = 10000000;	//nanoseconds a controller event may start late before it counts as missed
+const float detectionHysteresis = 1.5;		//exit threshold as a multiple of the enter threshold
+const float noEchoRange = 1000;			//range a reading with no echo stands for, beyond anything the sensor sees
+const float collectPeriod = 1;			//most seconds between collections of threaded samplers' readings
+const unsigned int metricsMagic = 0x46415254;	//"TRAF", marks a metrics segment
+const unsigned int metricsVersion = 1;			//bumped whenever struct Metrics changes
+const unsigned int monitorPeriod = 1000000;		//microseconds between lines printed by the monitor
+const long long monitorStale = 5000000000LL;	//nanoseconds without a publish before the monitor calls it stale
+const float saturationHeadway = 2;		//seconds between queued cars leaving on green, for demand estimates
+const float pressureMinGreen = 5;		//seconds a phase runs before max-pressure may switch away
+const float pressureCheckPeriod = 1;	//seconds between max-pressure looks at the queues once it may switch
+const float websterLostTime = 4;		//seconds lost per phase change in Webster's cycle formula
+const float websterMaxCycle = 120;		//longest cycle Webster's formula may pick
+const float corridorLinkTime = 30;		//seconds to drive from one corridor intersection to the next
+const float corridorTurnOffShare = 0.2;	//share of cars leaving the corridor at each intersection
+const float sweepMaxGreens[] = {10, 15, 20, 30, 45, 60};	//seconds, grid searched by the sweep
+const float sweepGapOuts[] = {2, 3, 5, 7, 10, 15};			//seconds
+const float sweepThresholds[] = {0.15, 0.3, 0.6};			//cm
+const int sweepRanked = 20;								//candidates listed in the sweep report
+
+//Simulation parameters
+const float simArrivalRateN = 0.2;		//default cars per second arriving from the north
+const float simArrivalRateW = 0.1;		//default cars per second arriving from the west
+const float simArrivalRateTable = 0.1;	//cars per second for table approaches that don't give a rate
+const float simHeadway = 2;				//seconds between queued cars crossing on green
+const float simOccupancy = 0.3;			//seconds a car stays over the sensor
+const float simNoCarRange = 250;		//range reported by an empty lane in cm
+const float simCarRangeMin = 0.05;		//nearest range in cm a car over the sensor reads
+const float simCarRangeMax = 0.3;		//farthest, so the default threshold sees every car
+const float simEchoRangeMax = 1;		//spurious echoes read anywhere from 0 to this many cm
+const double simNoiseProbability = 0.01;	//chance a reading of an empty lane is a spurious echo
+
+//Replay parameters
+const double replayTolerance = 1e-4;	//relative difference between two numbers a replay diff ignores
+const int replayDiffLines = 20;			//differing lines listed per file, the rest are only counted
 
 //Logging parameters
 int logDegree = 0;					//degree of logging; passed by user through argv, default is 0
 char date[80];
+const int logMessageDegree[25] = {0, 0, 0, 0, 5, 5, 5, 9, 9, 0, 0, 0, 0, 0, 5, 0, 5, 9, 0, 0, 0, 0, 0, 0, 0};	//logDegree must exceed this for each message
+struct Logger logger;
+
+#ifndef TRAFFIC_NO_LATENCY
+//Latency of the stages of the control loop, reported in *_LATENCY.stat
+struct LatencyHistogram latencyStages[LATENCY_STAGES];
+const char *latencyStageNames[LATENCY_STAGES] = {"readSensor", "Echo Wait", "GPIO Write", "Phase Switch", "Log Enqueue", "Log Write", "Journal Sync"};
+#endif
+
+//Output parameters
+float baselineGreenTime = 30;	//fixed green that Time Saved is measured against; TRAFFIC_BASELINE_GREEN overrides it
+const char *controlStrategyName = "gapout";	//reported in the stats files
+bool rawTextOutput = true;			//write *_RAW.rawstat text files
+bool rawBinaryOutput = false;		//write *_RAW.rawbin columnar files
+bool reportCsvOutput = false;		//write *_STATS.csv, a row per approach
+bool reportJsonOutput = false;		//write *_STATS.json
+const size_t reportFlushBytes = 1 << 20;	//report bytes held before a write, so a long raw file needs little memory
+
+//Fields of the stats reports in the order they are written
+const struct StatField statFields[] =
+{
+	{"Total Cars", "totalCars", "", STAT_INT, offsetof(struct StatsOverSimulation, totalCars)},
+	{"Total Time", "totalTime", " s", STAT_FLOAT, offsetof(struct StatsOverSimulation, totalTime)},
+	{"Max Cars", "maxCars", "", STAT_INT, offsetof(struct StatsOverSimulation, maxCars)},
+	{"Min Cars", "minCars", "", STAT_INT, offsetof(struct StatsOverSimulation, minCars)},
+	{"Average Cars", "averageCars", "", STAT_FLOAT, offsetof(struct StatsOverSimulation, averageCars)},
+	{"Average Time", "averageTime", " s", STAT_FLOAT, offsetof(struct StatsOverSimulation, averageTime)},
+	{"Mode(s) # of Cars", "modeCars", "", STAT_MODES, offsetof(struct StatsOverSimulation, modeCars)},
+	{"Maximum Cars Per Second", "maxCPS", " cps", STAT_FLOAT, offsetof(struct StatsOverSimulation, maxCPS)},
+	{"Minimim Cars Per Second", "minCPS", " cps", STAT_FLOAT, offsetof(struct StatsOverSimulation, minCPS)},
+	{"Average Cars Per Second", "avgCPS", " cps", STAT_FLOAT, offsetof(struct StatsOverSimulation, avgCPS)},
+	{"Median Cars Per Second", "medianCPS", " cps", STAT_FLOAT, offsetof(struct StatsOverSimulation, medianCPS)},
+	{"Population Standard Deviation Cars Per Second", "popStdDevCPS", " cps", STAT_FLOAT, offsetof(struct StatsOverSimulation, popStdDevCPS)},
+	{"Sample Standard Deviation Cars Per Second", "smplStdDevCPS", " cps", STAT_FLOAT, offsetof(struct StatsOverSimulation, smplStdDevCPS)},
+	{"Time Saved", "timeSaved", " s", STAT_FLOAT, offsetof(struct StatsOverSimulation, timeSaved)}
+};
+const int numStatFields = sizeof(statFields)/sizeof(statFields[0]);
+
+//Active backend; per thread so corridor workers can each drive their own intersection
+__thread struct Backend *backend;
+
+//Backend functions
+struct Backend *createOmegaBackend();
+struct Backend *createSimBackend(unsigned int seed);
+void destroySimBackend(struct Backend *simulated);
+bool omegaArmEdge(struct Backend *self, const unsigned int port);
+bool omegaWaitEdge(struct Backend *self, const unsigned int port, int level, long long timeout, long long *timestamp);
+long long omegaNow(struct Backend *self);
+void omegaSleepMicro(struct Backend *self, unsigned int microseconds);
+void omegaSleepUntil(struct Backend *self, long long time);
+bool omegaOpenChips(struct OmegaState *omega);
+struct OmegaChip *omegaChip(struct OmegaState *omega, const unsigned int port);
+void omegaLineRequestPin(struct Backend *self, const unsigned int port, bool output);
+bool omegaLineHoldPins(struct Backend *self);
+void omegaLineSetValue(struct Backend *self, const unsigned int port, int value);
+void omegaLineSetValues(struct Backend *self, const unsigned int ports[], const int values[], int count);
+int omegaLineGetValue(struct Backend *self, const unsigned int port);
+bool omegaLineArmEdge(struct Backend *self, const unsigned int port);
+bool omegaLineWaitEdge(struct Backend *self, const unsigned int port, int level, long long timeout, long long *timestamp);
+long long simNextGap(struct SimState *sim, double rate);
+void simAdvance(struct SimState *sim);
+void simAccumulateDelay(struct SimApproach *approach, long long until);
+void simRequestPin(struct Backend *self, const unsigned int port, bool output);
+void simSetValue(struct Backend *self, const unsigned int port, int value);
+int simGetValue(struct Backend *self, const unsigned int port);
+long long simNow(struct Backend *self);
+void simSleepMicro(struct Backend *self, unsigned int microseconds);
+void simSleepUntil(struct Backend *self, long long time);
+sensorRange simReadRange(struct Backend *self, const unsigned int gpioIn, const unsigned int gpioOut);
+void simAddApproach(struct Backend *self, const unsigned int gpioIn, const unsigned int greenPort, float arrivalRate);
+void simReport(struct Backend *self, struct ReportBuffer *report);
+long long simNextChange(struct Backend *self, const unsigned int gpioIn);
+void simInjectArrival(struct Backend *self, int approachIndex, long long time);
+void simRecordDepartures(struct Backend *self, int approachIndex);
+double simAverageDelay(struct Backend *self);
+int simTakeDepartures(struct Backend *self, int approachIndex, long long **times);
+struct Backend *createReplayBackend(const char *path);
+void destroyReplayBackend(struct Backend *replayed);
+bool replayBindTable(struct Backend *self, struct PhaseTable *table);
+int replayDuration(struct Backend *self);
+struct ReplaySensor *replayFindSensor(struct ReplayState *replay, const unsigned int gpioIn);
+void replayRequestPin(struct Backend *self, const unsigned int port, bool output);
+void replaySetValue(struct Backend *self, const unsigned int port, int value);
+int replayGetValue(struct Backend *self, const unsigned int port);
+long long replayNow(struct Backend *self);
+void replaySleepMicro(struct Backend *self, unsigned int microseconds);
+void replaySleepUntil(struct Backend *self, long long time);
+sensorRange replayReadRange(struct Backend *self, const unsigned int gpioIn, const unsigned int gpioOut);
+void replayAddApproach(struct Backend *self, const unsigned int gpioIn, const unsigned int greenPort, float arrivalRate);
+long long replayNextChange(struct Backend *self, const unsigned int gpioIn);
 
 //LED functions
 bool light_on (const unsigned int port);
 bool light_off (const unsigned int port);
+void setPhaseLights (struct PhaseTable *table, struct Phase *phase);
+void setLights (const unsigned int ports[], const int values[], int count);
+
+//Phase table functions
+void defaultPhaseTable (struct PhaseTable *table);
+bool loadPhaseTable (const char *filename, struct PhaseTable *table);
+int findApproach (struct PhaseTable *table, const char *name);
 
 //Time functions
 int deltaTime (const int oldTime);
 int timeUpdate();
 int minutesToSeconds (int minutes);
+long long secondsToNanos (float seconds);
+void sleepUntil (long long time);
 
 //Sensor functions
-float readSensor (const unsigned int gpioIn, const unsigned int gpioOut);
+sensorRange readSensor (const unsigned int gpioIn, const unsigned int gpioOut);
+bool waitForEcho(const unsigned int gpioIn, int level, long long timeout, bool edges, long long *timestamp);
 bool carPassed(const unsigned int gpioIn, const unsigned int gpioOut, const float threshold);
 
+//Controller functions
+void controllerInit (struct Controller *ctrl, struct PhaseTable *table, const struct ControlStrategy *strategy, struct Sampler *samplers, bool threadedSampling);
+bool controllerStep (struct Controller *ctrl);
+void controllerCollect (struct Controller *ctrl);
+void controllerSchedule (struct Controller *ctrl);
+long long controllerNextEvent (struct Controller *ctrl);
+void freeController (struct Controller *ctrl);
+void eventPush (struct EventQueue *queue, struct Event event);
+bool eventPop (struct EventQueue *queue, struct Event *event);
+void controllerStartPhase (struct Controller *ctrl);
+void controllerEndPhase (struct Controller *ctrl, float timeInterval);
+const struct ControlStrategy *findStrategy (const char *name);
+bool gapOutPhaseDone (struct Controller *ctrl, float elapsed, float sinceLastCar, float *timeInterval);
+bool fixedPhaseDone (struct Controller *ctrl, float elapsed, float sinceLastCar, float *timeInterval);
+bool maxPressurePhaseDone (struct Controller *ctrl, float elapsed, float sinceLastCar, float *timeInterval);
+void websterStartPhase (struct Controller *ctrl);
+bool websterPhaseDone (struct Controller *ctrl, float elapsed, float sinceLastCar, float *timeInterval);
+long long gapOutNextDecision (struct Controller *ctrl);
+long long fixedNextDecision (struct Controller *ctrl);
+long long maxPressureNextDecision (struct Controller *ctrl);
+long long websterNextDecision (struct Controller *ctrl);
+int cyclicNextPhase (struct Controller *ctrl);
+int maxPressureNextPhase (struct Controller *ctrl);
+float phasePressure (struct Controller *ctrl, int phase);
+bool writeStrategyReport (char filename[], struct Controller *ctrl, struct StatsOverSimulation statsSim[]);
+bool writeTimingReport (char filename[], struct Controller *ctrl);
+void writeTiming (struct ReportBuffer *report, const char *name, struct TimingStats *timing);
+void writeReports (struct Controller *ctrl);
+
+//Daemon functions
+int runDaemon (struct Controller *ctrl, int rotationTime);
+void rotateOutput (struct Controller *ctrl, const char *nextDate);
+void requestStop (int signum);
+void initWindows (struct RollingWindows *windows, long long minute);
+void windowAdvance (struct RollingWindows *windows, long long minute);
+void windowAdd (struct RollingWindows *windows, struct StatsOverInterval interval, long long minute);
+bool writeWindowReport (char filename[], struct Controller *ctrl);
+
+//Simulated intersection functions
+void initSimIntersection (struct SimIntersection *node, const struct ControlStrategy *strategy, unsigned int seed, float threshold, int maxIntervals);
+void freeSimIntersection (struct SimIntersection *node);
+void controllerRunUntil (struct Controller *ctrl, long long until);
+
+//Parameter sweep functions
+int runSweep (struct PhaseTable *table, const struct ControlStrategy *strategy, int simulationTime, unsigned int seed, int numWorkers);
+void runSweepBatch (struct Sweep *sweep, int numWorkers);
+void *sweepWorker (void *arg);
+void evaluateCandidate (struct Sweep *sweep, struct SweepCandidate *candidate);
+int compareResults (const struct SweepCandidate *first, const struct SweepCandidate *second);
+int compareCandidates (const void *a, const void *b);
+bool writeSweepReport (char filename[], struct SweepCandidate candidates[], int numCandidates);
+
+//Corridor functions
+int runCorridor (struct PhaseTable *table, const struct ControlStrategy *strategy, int simulationTime, int numNodes, unsigned int seed, int numWorkers);
+void *corridorWorker (void *arg);
+int corridorTakeNode (struct Corridor *corridor, int id);
+void corridorRunNode (struct Corridor *corridor, int index, int epoch);
+bool writeCorridorReport (char filename[], struct Corridor *corridor, double wallSeconds);
+
+//Aggregation functions
+int runAggregate (const char *directory, int numWorkers);
+bool collectRunFiles (struct Aggregation *aggregation, const char *directory);
+bool siblingExists (const char *path, const char *suffix, const char *replacement);
+void *aggregateWorker (void *arg);
+struct AggregateApproach *aggregateApproach (struct AggregatePartial *partial, const char *name);
+bool aggregateRawText (struct AggregatePartial *partial, const char *path);
+bool aggregateRawBinary (struct AggregatePartial *partial, const char *path);
+bool aggregateStatFile (struct AggregatePartial *partial, const char *path);
+void mergePartial (struct AggregatePartial *total, struct AggregatePartial *partial);
+int compareAggregateApproaches (const void *a, const void *b);
+void freePartial (struct AggregatePartial *partial);
+bool writeAggregateReport (char filename[], const char *directory, struct AggregatePartial *total, struct Aggregation *aggregation, int numWorkers, double wallSeconds);
+
+//Sampler functions
+void startSamplers (struct Sampler samplers[], struct PhaseTable *table, float threshold, bool threaded);
+void stopSamplers (struct Sampler samplers[], int numSamplers);
+void *samplerThread (void *arg);
+void recordLateness (struct TimingStats *timing, long long lateness, bool missed);
+void sampleSensor (struct Sampler *sampler);
+bool pushSample (struct SampleQueue *queue, struct RangeSample sample);
+bool popSample (struct SampleQueue *queue, struct RangeSample *sample);
+
+//Detection functions
+void initDetector (struct Detector *detector, float threshold);
+int detectorProcess (struct Detector *detector, struct RangeSample samples[], int numSamples, struct VehicleEvent events[]);
+void medianFilter (const sensorRange input[], sensorRange output[], int numOutputs);
+bool detectorSettled (struct Detector *detector);
+
+//Metrics functions
+struct MetricsSegment *openMetrics (const char *path, struct PhaseTable *table);
+void publishMetrics (struct Controller *ctrl);
+void closeMetrics (struct MetricsSegment *metrics);
+bool readMetrics (struct MetricsSegment *metrics, struct Metrics *snapshot);
+int runMonitor (const char *path, int count);
+
 //Statistic Functions
-float calcCarsPerSecond (struct StatsOverInterval intervalStats);
+intervalCPS calcCarsPerSecond (struct StatsOverInterval intervalStats);
 int calcTotalCars (struct StatsOverInterval statsInterval[], int sizeStats);
 float calcTotalTime (struct StatsOverInterval statsInterval[], int sizeStats);
 int calcMaxCars (struct StatsOverInterval statsInterval[], int sizeStats);
@@ -79,9 +1087,11 @@ float calcAvgCars (struct StatsOverInterval statsInterval[], int sizeStats);
 float calcAvgTime (struct StatsOverInterval statsInterval[], int sizeStats);
 int calcModeCars (struct StatsOverInterval statsInterval[], int sizeStats, int modes[]); 
 bool sortInt(int dataset[], const int size);
-bool selectionInt(int dataset[], const int size, int index);
+int compareInt(const void *a, const void *b);
 bool sortFloat(float dataset[], const int size);
-bool selectionFloat(float dataset[], const int size, int index);
+int compareFloat(const void *a, const void *b);
+int compareCPS(const void *a, const void *b);
+uint32_t integerSqrt(uint64_t value);
 float calcMaxCPS (struct StatsOverInterval statsInterval[], int sizeStats);
 float calcMinCPS (struct StatsOverInterval statsInterval[], int sizeStats);
 float calcAverageCPS (struct StatsOverInterval statsInterval[], int sizeStats);
@@ -91,21 +1101,149 @@ float calcSmplStdDevCPS(struct StatsOverInterval statsInterval[], int sizeStats)
 float calcTimeSaved (struct StatsOverInterval statsInterval[], int sizeStats, const float defaultIntersectionTime);
 struct StatsOverSimulation computeStatsOverSimulation(struct StatsOverInterval intervalStats[], int sizeStats);
 
+//Streaming statistic functions
+void initAccumulator(struct StatsAccumulator *acc);
+void accumulateInterval(struct StatsAccumulator *acc, struct StatsOverInterval interval);
+struct StatsOverSimulation snapshotAccumulator(struct StatsAccumulator *acc, const float defaultIntersectionTime);
+void freeAccumulator(struct StatsAccumulator *acc);
+void mergeAccumulator(struct StatsAccumulator *acc, struct StatsAccumulator *other);
+void selectCPS(intervalCPS values[], int size, int k);
+void freeStatsOverSimulation(struct StatsOverSimulation *statsSim);
+
+//Interval storage functions
+bool initIntervalStore(struct IntervalStore *store, int maxSize, char spillFilename[]);
+bool intervalStorePush(struct IntervalStore *store, struct StatsOverInterval interval);
+struct StatsOverInterval *intervalStoreGet(struct IntervalStore *store, int index);
+int intervalsPerChunk();
+void clearIntervalStore(struct IntervalStore *store);
+void freeIntervalStore(struct IntervalStore *store);
+int envInt(const char *name, int fallback);
+
+//Journal functions
+struct Journal *openJournal(const char *path, struct PhaseTable *table, int syncEvery);
+bool recoverJournal(struct Journal *journal, struct PhaseTable *table);
+bool journalMapChunk(struct Journal *journal, off_t offset);
+bool journalAppend(struct Journal *journal, int approach, struct StatsOverInterval interval);
+void journalSync(struct Journal *journal);
+void closeJournal(struct Journal *journal, bool clean);
+uint32_t journalChecksum(struct JournalRecord record);
+void heapPush(intervalCPS heap[], int size, intervalCPS value, bool maxHeap);
+intervalCPS heapPop(intervalCPS heap[], int size, bool maxHeap);
+
 //Filewriting functions
-bool writeStatsToFile (char filename[], struct StatsOverInterval statsIntervalNorth[], int sizeNorth, 
-			struct StatsOverInterval statsIntervalWest[], int sizeWest, 
-			struct StatsOverSimulation statsSimNorth, struct StatsOverSimulation statsSimWest);
+bool writeStatsToFile (char filename[], struct Approach approaches[], int numApproaches, struct StatsOverSimulation statsSim[]);
+bool writeStatsCsv (struct ReportBuffer *report, const char *fullFilename, const char *names[], int numApproaches, struct StatsOverSimulation statsSim[]);
+bool writeStatsJson (struct ReportBuffer *report, const char *fullFilename, const char *names[], int numApproaches, struct StatsOverSimulation statsSim[]);
+void readOutputOptions ();
+bool reportOpen(struct ReportBuffer *report, const char *filename, size_t expectedBytes);
+void reportPrintf(struct ReportBuffer *report, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void reportStatValue(struct ReportBuffer *report, const struct StatField *field, struct StatsOverSimulation *stats, char format);
+bool reportWrite(struct ReportBuffer *report);
+bool reportClose(struct ReportBuffer *report);
 bool writeToLog(char filename[], int degreeLogging, int logMessageNumber, char tag[], float value);
+bool writeRawBinaryFile (char filename[], struct IntervalStore *statsInterval, char direction[]);
+bool writeColumn (int fd, struct IntervalStore *statsInterval, int column);
+
+//Binary raw data reading functions
+bool openRawBinary(const char *path, struct RawBinaryView *view);
+void closeRawBinary(struct RawBinaryView *view);
+
+//Raw trace functions
+struct TraceRecorder *openTrace(const char *path, struct PhaseTable *table);
+void traceRecord(struct TraceRecorder *trace, int sensor, struct RangeSample sample);
+void *traceWriter(void *arg);
+unsigned long closeTrace(struct TraceRecorder *trace);
+int putVarint(unsigned char *out, uint64_t value);
+bool getVarint(const unsigned char *in, uint32_t length, uint32_t *position, uint64_t *value);
+bool openTraceReader(const char *path, struct TraceReader *reader);
+bool traceNext(struct TraceReader *reader, int *sensor, struct RangeSample *sample);
+void closeTraceReader(struct TraceReader *reader);
+int dumpTrace(const char *path);
+
+//Replay diff functions
+char **loadBaseline(const char *prefix, struct PhaseTable *table);
+char *readWholeFile(const char *path);
+bool numbersMatch(const char *baseline, const char *replay);
+int diffStatsFile(struct ReportBuffer *report, const char *name, char *baseline, const char *path);
+int writeReplayDiff(char filename[], const char *prefix, struct PhaseTable *table, char **baseline);
+
+#ifndef TRAFFIC_NO_LATENCY
+//Latency histogram functions
+static inline long long latencyNow();
+void recordLatency(struct LatencyHistogram *histogram, long long latency);
+int latencyBucket(long long latency);
+long long latencyBucketStart(int bucket);
+long long latencyPercentile(struct LatencyHistogram *histogram, double percentile);
+bool writeLatencyReport(char filename[]);
+#endif
+
+//Logger functions
+bool startLogger(char filename[]);
+void stopLogger();
+void *logWriter(void *arg);
+void formatLogRecord(FILE *fptr, struct LogRecord *record);
+
+#ifdef TRAFFIC_BENCH
+//Benchmark functions
+int runBenchmarks(int argc, char **argv);
+long long benchNow();
+void benchReport(const char *name, int size, int iterations, long long elapsed);
+void benchIntervals(struct StatsOverInterval intervals[], int size);
+struct Backend *createMockBackend(bool edges);
+void mockSetValue(struct Backend *self, const unsigned int port, int value);
+int mockGetValue(struct Backend *self, const unsigned int port);
+long long mockNow(struct Backend *self);
+void mockSleepMicro(struct Backend *self, unsigned int microseconds);
+bool mockArmEdge(struct Backend *self, const unsigned int port);
+bool mockWaitEdge(struct Backend *self, const unsigned int port, int level, long long timeout, long long *timestamp);
+#endif
+
+//Control strategies; TRAFFIC_STRATEGY picks one by name, gapout is the default
+const struct ControlStrategy strategies[] =
+{
+	{"gapout", NULL, gapOutPhaseDone, gapOutNextDecision, cyclicNextPhase},						//fixed maximum green, ends early after a gap in traffic
+	{"fixed", NULL, fixedPhaseDone, fixedNextDecision, cyclicNextPhase},							//always the maximum green
+	{"maxpressure", NULL, maxPressurePhaseDone, maxPressureNextDecision, maxPressureNextPhase},	//serves the phase with the most cars queued
+	{"webster", websterStartPhase, websterPhaseDone, websterNextDecision, cyclicNextPhase},		//splits the cycle by measured flow ratios
+};
+const int numStrategies = sizeof(strategies)/sizeof(strategies[0]);
 
 int main(int argc, char **argv, char **envp)
 {
+#ifdef TRAFFIC_BENCH
+	return runBenchmarks(argc, argv);
+#endif
+
+	//"traffic monitor [file] [lines]" follows the metrics a running controller publishes
+	if (argc > 1 && strcmp(argv[1], "monitor") == 0)
+	{
+		const char *metricsFile = argc > 2 ? argv[2] : getenv("TRAFFIC_METRICS");
+		
+		if (metricsFile == NULL)
+		{
+			fprintf(stderr, "No metrics file given and TRAFFIC_METRICS is not set\n");
+			return 1;
+		}
+		
+		return runMonitor(metricsFile, argc > 3 ? atoi(argv[3]) : 0);
+	}
+	
+	//"traffic trace <file>" prints a raw sensor trace as CSV
+	if (argc > 2 && strcmp(argv[1], "trace") == 0)
+	{
+		return dumpTrace(argv[2]);
+	}
+	
+	//"traffic aggregate <dir> [workers]" merges the stats of every run saved under a directory
+	if (argc > 2 && strcmp(argv[1], "aggregate") == 0)
+	{
+		readOutputOptions();
+		return runAggregate(argv[2], argc > 3 ? atoi(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN));
+	}
 
 	int simulationTime;			//time of simulation; passed by user through argv, default is 5 min
 	int simulationTimer; 		//timer to keep track of when simulation should end
 	
-	char northTag[] = "North";	//Tag for logging purposes
-	char westTag[] = "West";	//Tag for logging purposes
-	
 	//Get Date and Time of Simulation (used for name of output files)
   	struct timeval tv;
   	time_t curtime;
@@ -129,989 +1267,7377 @@ int main(int argc, char **argv, char **envp)
 		simulationTime = minutesToSeconds(atoi(argv[1]));
 	}
 	
+	//select backend; "sim" runs against synthetic traffic on a virtual clock, as does every intersection of a "corridor" or "sweep"
+	//"daemon" runs until stopped, rotating its output every argv[1] minutes; "daemon sim" does so on a virtual clock
+	//"replay <trace> [baseline]" runs a recorded trace as fast as it decodes and diffs the stats with the baseline's
+	bool daemonMode = argc > 3 && strcmp(argv[3], "daemon") == 0;
+	bool replayMode = argc > 4 && strcmp(argv[3], "replay") == 0;
+	char *baselinePrefix = replayMode && argc > 5 ? argv[5] : NULL;
+	
+	//argv[1] is the rotation period of a daemon; 0, or anything atoi can't read, would never rotate
+	if (daemonMode && simulationTime <= 0)
+	{
+		fprintf(stderr, "A daemon needs a rotation period of at least one minute\n");
+		return 1;
+	}
+	
+	if (replayMode)
+	{
+		backend = createReplayBackend(argv[4]);
+		
+		if (backend == NULL)
+		{
+			fprintf(stderr, "Could not read trace %s\n", argv[4]);
+			return 1;
+		}
+	}
+	else if (argc > 3 && (strcmp(argv[3], "sim") == 0 || strcmp(argv[3], "sweep") == 0))
+	{
+		backend = createSimBackend(argc > 4 ? atoi(argv[4]) : 1);
+	}
+	else if (argc > 3 && strcmp(argv[3], "corridor") == 0)
+	{
+		backend = createSimBackend(argc > 5 ? atoi(argv[5]) : 1);	//argv[4] is the number of intersections
+	}
+	else if (daemonMode && argc > 4 && strcmp(argv[4], "sim") == 0)
+	{
+		backend = createSimBackend(argc > 5 ? atoi(argv[5]) : 1);
+	}
+	else
+	{
+		backend = createOmegaBackend();
+	}
+	
+	if (backend == NULL)
+	{
+		fprintf(stderr, "Backend unavailable in this build\n");
+		return 1;
+	}
+	
+	readOutputOptions();
+	
+	//a virtual clock doesn't care how long logging takes, so keep every message
+	logger.lossless = backend->virtualTime;
+	
 	writeToLog(date, logDegree, 0, 0, 0);
 	
 	char tag1[] = "Simulation time";
 	writeToLog(date, logDegree, 13, tag1, simulationTime);
 	
-	//request gpios and direction setup
-	//NORTH
-	gpio_request(SENS_N_OUT, NULL);
-	gpio_direction_output(SENS_N_OUT, 0);
-	gpio_request(SENS_N_IN, NULL);
-	gpio_direction_input(SENS_N_IN);
-	gpio_request(GRN_N, NULL);
-	gpio_direction_output(GRN_N, 0);
-	gpio_request(RED_N, NULL);
-	gpio_direction_output(RED_N, 0); 
-	
-	//Log appropriate north pins
-	char ntag1[] = "SENS_N_OUT";
-	char ntag2[] = "SENS_N_IN";
-	char ntag3[] = "GRN_N";
-	char ntag4[] = "RED_N";
-	writeToLog(date, logDegree, 1, ntag1, SENS_N_OUT);
-	writeToLog(date, logDegree, 1, ntag2, SENS_N_IN);
-	writeToLog(date, logDegree, 2, ntag4, RED_N);
-	writeToLog(date, logDegree, 3, ntag3, GRN_N);
-	
-	
-	//WEST
-	gpio_request(SENS_W_OUT, NULL);
-	gpio_direction_output(SENS_W_OUT, 0);
-	gpio_request(SENS_W_IN, NULL);
-	gpio_direction_input(SENS_W_IN);
-	gpio_request(GRN_W, NULL);
-	gpio_direction_output(GRN_W, 0);
-	gpio_request(RED_W, NULL);
-	gpio_direction_output(RED_W, 0);	
-    
-	//Log appropriate west pins
-	char wtag1[] = "SENS_W_OUT";
-	char wtag2[] = "SENS_W_IN";
-	char wtag3[] = "GRN_W";
-	char wtag4[] = "RED_W";
-	writeToLog(date, logDegree, 1, ntag1, SENS_W_OUT);
-	writeToLog(date, logDegree, 1, ntag2, SENS_W_IN);
-	writeToLog(date, logDegree, 2, ntag4, RED_W);
-	writeToLog(date, logDegree, 3, ntag3, GRN_W);
-	
-    //Set Simulation Timer
-	gettimeofday(&tv, NULL);
-	simulationTimer = tv.tv_sec;
-	
-	//set up state of program
-	char currentState = 'n'; //north is green
-	
-	//declare arrays to store raw data for each intersection direction
-	struct StatsOverInterval north[10000];
-	int sizeNorth = 0;
-	struct StatsOverInterval west[10000];
-	int sizeWest = 0;
-	
-	//state machine variables
-	bool done = false;
-	int timerMain;
-	int timerOpti;
-	int carCounter = 0;
-	struct StatsOverInterval intervalStat;
+	//load the approaches and phase sequence; TRAFFIC_PHASE_TABLE names a table file, otherwise north/west
+	struct PhaseTable table;
+	char *tableFile = getenv("TRAFFIC_PHASE_TABLE");
 	
-
-	//Initialising intersection lights
-	light_on(GRN_W);
-	sleep(1);
-	light_off(GRN_W);
-	sleep(1);
-	light_on(RED_W);
-	sleep(1);
-	light_off(RED_W);
-	sleep(1);
-	light_on(GRN_N);
-	sleep(1);
-	light_off(GRN_N);
-	sleep(1);
-	light_on(RED_N);
-	sleep(1);
-	light_off(RED_N);
-	sleep(1);
-
-	//state machine
-	while (deltaTime(simulationTimer) < simulationTime)
-	{
-		switch (currentState)
-		{
-			case 'n':
-			
-				light_on(GRN_N);
-				light_off(RED_N);
-				light_on(RED_W);
-				light_off(GRN_W);
-				
-				done = false;
-				timerMain = timeUpdate();
-				timerOpti = timeUpdate();
-				carCounter = 0;
+	if (tableFile != NULL)
+	{
+		if (!loadPhaseTable(tableFile, &table))
+		{
+			fprintf(stderr, "Could not load phase table %s\n", tableFile);
+			stopLogger();
+			return 1;
+		}
+	}
+	else
+	{
+		defaultPhaseTable(&table);
+	}
+	
+	//control strategy
+	char *strategyName = getenv("TRAFFIC_STRATEGY");
+	const struct ControlStrategy *strategy = findStrategy(strategyName != NULL ? strategyName : "gapout");
+	
+	if (strategy == NULL)
+	{
+		fprintf(stderr, "Unknown control strategy %s\n", strategyName);
+		stopLogger();
+		return 1;
+	}
+	
+	controlStrategyName = strategy->name;
+	
+	char strategyTag[] = "Control strategy";
+	writeToLog(date, logDegree, 13, strategyTag, strategy - strategies);
+	
+	//a replay runs for argv[1] minutes of the trace, or all of it when that is 0 or longer than the trace
+	char **baseline = NULL;
+	
+	if (replayMode)
+	{
+		if (!replayBindTable(backend, &table))
+		{
+			destroyReplayBackend(backend);
+			stopLogger();
+			return 1;
+		}
+		
+		if (simulationTime <= 0 || simulationTime > replayDuration(backend))
+		{
+			simulationTime = replayDuration(backend);
+		}
+		
+		writeToLog(date, logDegree, 22, argv[4], ((struct ReplayState *)backend->state)->readings);
+		
+		if (baselinePrefix != NULL)
+		{
+			baseline = loadBaseline(baselinePrefix, &table);
+		}
+	}
+	
+	//"sweep" searches for the best green time and gap-out for the table on every core
+	if (argc > 3 && strcmp(argv[3], "sweep") == 0)
+	{
+		unsigned int seed = argc > 4 ? atoi(argv[4]) : 1;
+		int numWorkers = argc > 5 ? atoi(argv[5]) : sysconf(_SC_NPROCESSORS_ONLN);
+		int result = runSweep(&table, strategy, simulationTime, seed, numWorkers);
+		
+		writeToLog(date, logDegree, 12, 0, 0);
+		stopLogger();
+		return result;
+	}
+	
+	//"corridor" simulates a chain of intersections built from the table on every core
+	if (argc > 3 && strcmp(argv[3], "corridor") == 0)
+	{
+		int numNodes = argc > 4 ? atoi(argv[4]) : 100;
+		unsigned int seed = argc > 5 ? atoi(argv[5]) : 1;
+		int numWorkers = argc > 6 ? atoi(argv[6]) : sysconf(_SC_NPROCESSORS_ONLN);
+		int result = runCorridor(&table, strategy, simulationTime, numNodes, seed, numWorkers);
+		
+		writeToLog(date, logDegree, 12, 0, 0);
+		stopLogger();
+		return result;
+	}
+	
+	//declare stores for raw data for each approach; TRAFFIC_MAX_INTERVALS caps them and
+	//TRAFFIC_SPILL_DIR backs them with memory-mapped files instead of RAM
+	int maxIntervals = envInt("TRAFFIC_MAX_INTERVALS", 0);
+	char *spillDir = getenv("TRAFFIC_SPILL_DIR");
+	
+	for (int i = 0; i < table.numApproaches; i++)
+	{
+		struct Approach *approach = &table.approaches[i];
+		char spillFile[200];
+		
+		if (spillDir != NULL)
+		{
+			snprintf(spillFile, sizeof(spillFile), "%s/%s_%s.spill", spillDir, date, approach->name);
+		}
+		
+		if (!initIntervalStore(&approach->intervals, maxIntervals, spillDir != NULL ? spillFile : NULL))
+		{
+			fprintf(stderr, "Could not create interval spill files in %s\n", spillDir);
+			stopLogger();
+			return 1;
+		}
+		
+		//running statistics, updated as every interval completes
+		initAccumulator(&approach->stats);
+		
+		//request gpios and direction setup
+		backend->requestPin(backend, approach->sensorOut, true);
+		backend->requestPin(backend, approach->sensorIn, false);
+		backend->requestPin(backend, approach->greenPort, true);
+		backend->requestPin(backend, approach->redPort, true);
+		
+		if (backend->addApproach != NULL)
+		{
+			backend->addApproach(backend, approach->sensorIn, approach->greenPort, approach->arrivalRate);
+		}
+		
+		//Log appropriate pins
+		writeToLog(date, logDegree, 1, approach->name, approach->sensorOut);
+		writeToLog(date, logDegree, 1, approach->name, approach->sensorIn);
+		writeToLog(date, logDegree, 2, approach->name, approach->redPort);
+		writeToLog(date, logDegree, 3, approach->name, approach->greenPort);
+	}
+	
+	//every pin is requested by now, so the backend can take all the outputs at once
+	if (backend->holdPins != NULL && !backend->holdPins(backend))
+	{
+		fprintf(stderr, "Could not hold the gpio outputs\n");
+		stopLogger();
+		return 1;
+	}
+	
+	//TRAFFIC_JOURNAL names a file every completed interval is appended to, so a crash loses at most the
+	//last group commit (TRAFFIC_JOURNAL_SYNC intervals); an unfinished run found there is carried on
+	char *journalFile = getenv("TRAFFIC_JOURNAL");
+	struct Journal *journal = NULL;
+	
+	if (journalFile != NULL)
+	{
+		journal = openJournal(journalFile, &table, envInt("TRAFFIC_JOURNAL_SYNC", defaultJournalSync));
+		
+		if (journal == NULL)
+		{
+			fprintf(stderr, "Could not open journal %s\n", journalFile);
+			stopLogger();
+			return 1;
+		}
+		
+		if (journal->recovered > 0)
+		{
+			writeToLog(date, logDegree, 18, journalFile, journal->recovered);
+		}
+	}
+	
+    //Set Simulation Timer
+	simulationTimer = timeUpdate();
+	
+	//every sensor is sampled all the time, green or red; with a real clock each one gets its own thread
+	struct Sampler samplers[MAX_APPROACHES];
+	bool threadedSampling = !backend->virtualTime;
+	
+	//Initialising intersection lights
+	for (int i = 0; i < table.numApproaches; i++)
+	{
+		light_on(table.approaches[i].greenPort);
+		backend->sleepMicro(backend, 1000000);
+		light_off(table.approaches[i].greenPort);
+		backend->sleepMicro(backend, 1000000);
+		light_on(table.approaches[i].redPort);
+		backend->sleepMicro(backend, 1000000);
+		light_off(table.approaches[i].redPort);
+		backend->sleepMicro(backend, 1000000);
+	}
+	
+	startSamplers(samplers, &table, defaultThreshold, threadedSampling);
+	
+	struct Controller controller;
+	controllerInit(&controller, &table, strategy, samplers, threadedSampling);
+	controller.journal = journal;
+	
+	//TRAFFIC_TRACE names a file every raw sensor reading is recorded to, for reprocessing later
+	char *traceFile = getenv("TRAFFIC_TRACE");
+	
+	if (traceFile != NULL)
+	{
+		controller.trace = openTrace(traceFile, &table);
+		
+		if (controller.trace == NULL)
+		{
+			fprintf(stderr, "Could not create trace file %s\n", traceFile);
+		}
+	}
+	
+	//TRAFFIC_METRICS names a file (best on tmpfs, e.g. /dev/shm) to publish live counters to
+	char *metricsFile = getenv("TRAFFIC_METRICS");
+	
+	if (metricsFile != NULL)
+	{
+		controller.metrics = openMetrics(metricsFile, &table);
+		
+		if (controller.metrics == NULL)
+		{
+			fprintf(stderr, "Could not create metrics file %s\n", metricsFile);
+		}
+	}
+
+	if (daemonMode)
+	{
+		runDaemon(&controller, simulationTime);
+	}
+	else
+	{
+		//state machine: a phase that is running when time is up still runs to its end
+		while (deltaTime(simulationTimer) < simulationTime)
+		{
+			while (!controllerStep(&controller));
+		}
+	}
+	
+	stopSamplers(samplers, table.numApproaches);
+	controllerCollect(&controller);		//the readings still queued belong in the trace too
+	
+	if (controller.trace != NULL)
+	{
+		writeToLog(date, logDegree, 20, traceFile, controller.trace->recorded);
+		
+		unsigned long dropped = closeTrace(controller.trace);
+		
+		if (dropped > 0)
+		{
+			writeToLog(date, logDegree, 21, traceFile, dropped);
+		}
+		
+		controller.trace = NULL;
+	}
+	
+	closeMetrics(controller.metrics);
+	freeController(&controller);
+	
+	for (int i = 0; i < table.numApproaches; i++)
+	{
+		light_off(table.approaches[i].greenPort);
+		light_off(table.approaches[i].redPort);
+	}
+
+	//statistics are already up to date; write out the final values
+	writeReports(&controller);
+	
+	//the stats are written, so the journal's run is finished
+	closeJournal(controller.journal, true);
+	free(controller.windows);
+	
+	for (int i = 0; i < table.numApproaches; i++)
+	{
+		freeAccumulator(&table.approaches[i].stats);
+		freeIntervalStore(&table.approaches[i].intervals);
+	}
+	
+	//a replay that differs from its baseline fails, so a change to the controller can be checked by script
+	int result = 0;
+	
+	if (baseline != NULL)
+	{
+		int differences = writeReplayDiff(date, baselinePrefix, &table, baseline);
+		
+		if (differences < 0)
+		{
+			fprintf(stderr, "Could not write %s_DIFF.stat\n", date);
+			result = 1;
+		}
+		else if (differences > 0)
+		{
+			fprintf(stderr, "%d lines differ from %s, see %s_DIFF.stat\n", differences, baselinePrefix, date);
+			result = 1;
+		}
+	}
+	
+	if (replayMode)
+	{
+		destroyReplayBackend(backend);
+	}
+	
+	writeToLog(date, logDegree, 12, 0, 0);
+	stopLogger();
+	return result;
+
+}
+
+#ifndef TRAFFIC_SIM_ONLY
+void omegaRequestPin(struct Backend *self, const unsigned int port, bool output)
+{
+	gpio_request(port, NULL);
+	
+	if (output)
+	{
+		gpio_direction_output(port, 0);
+	}
+	else
+	{
+		gpio_direction_input(port);
+	}
+}
+
+void omegaSetValue(struct Backend *self, const unsigned int port, int value)
+{
+	gpio_set_value(port, value);
+}
+
+int omegaGetValue(struct Backend *self, const unsigned int port)
+{
+	return gpio_get_value(port);
+}
+
+//open every gpio character device; gpio numbers run on from one chip to the next, as on the Omega2
+bool omegaOpenChips(struct OmegaState *omega)
+{
+	unsigned int base = 0;
+	
+	for (int n = 0; n < OMEGA_MAX_CHIPS; n++)
+	{
+		char path[32];
+		struct gpiochip_info info;
+		
+		snprintf(path, sizeof(path), "/dev/gpiochip%d", n);
+		int fd = open(path, O_RDWR | O_CLOEXEC);
+		
+		if (fd < 0)
+		{
+			break;
+		}
+		
+		if (ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) != 0)
+		{
+			close(fd);
+			break;
+		}
+		
+		struct OmegaChip *chip = &omega->chips[omega->numChips++];
+		chip->fd = fd;
+		chip->base = base;
+		chip->lines = info.lines;
+		chip->handleFd = -1;
+		pthread_mutex_init(&chip->lock, NULL);
+		base += info.lines;
+	}
+	
+	return omega->numChips > 0;
+}
+
+struct OmegaChip *omegaChip(struct OmegaState *omega, const unsigned int port)
+{
+	for (int n = 0; n < omega->numChips; n++)
+	{
+		if (port >= omega->chips[n].base && port < omega->chips[n].base + omega->chips[n].lines)
+		{
+			return &omega->chips[n];
+		}
+	}
+	
+	return NULL;
+}
+
+//outputs are only recorded here and requested together by omegaLineHoldPins; inputs are requested at once
+void omegaLineRequestPin(struct Backend *self, const unsigned int port, bool output)
+{
+	struct OmegaState *omega = self->state;
+	struct OmegaChip *chip = omegaChip(omega, port);
+	int index = port % 64;
+	
+	if (chip == NULL)
+	{
+		return;
+	}
+	
+	if (output)
+	{
+		pthread_mutex_lock(&chip->lock);
+		
+		//adding a line would mean giving up the handle and leaving every light on the chip unheld for a moment
+		if (chip->handleFd >= 0)
+		{
+			fprintf(stderr, "Could not request gpio output %u: outputs are held since startup\n", port);
+		}
+		else if (omega->outputSlot[index] < 0 && chip->numOutputs < OMEGA_HANDLE_LINES)
+		{
+			omega->outputSlot[index] = chip->numOutputs;
+			chip->outputs[chip->numOutputs] = port - chip->base;
+			chip->values[chip->numOutputs] = 0;
+			chip->numOutputs++;
+		}
+		
+		pthread_mutex_unlock(&chip->lock);
+		
+		return;
+	}
+	
+	if (omega->inputFd[index] >= 0)
+	{
+		return;
+	}
+	
+	//an echo pin wants both edges; lines without interrupts still read as plain inputs
+	struct gpioevent_request events;
+	memset(&events, 0, sizeof(events));
+	events.lineoffset = port - chip->base;
+	events.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	events.eventflags = GPIOEVENT_REQUEST_BOTH_EDGES;
+	strcpy(events.consumer_label, "traffic");
+	
+	if (ioctl(chip->fd, GPIO_GET_LINEEVENT_IOCTL, &events) == 0)
+	{
+		fcntl(events.fd, F_SETFL, O_NONBLOCK);
+		omega->inputFd[index] = events.fd;
+		omega->inputEdges[index] = true;
+		return;
+	}
+	
+	struct gpiohandle_request request;
+	memset(&request, 0, sizeof(request));
+	request.lineoffsets[0] = port - chip->base;
+	request.lines = 1;
+	request.flags = GPIOHANDLE_REQUEST_INPUT;
+	strcpy(request.consumer_label, "traffic");
+	
+	if (ioctl(chip->fd, GPIO_GET_LINEHANDLE_IOCTL, &request) == 0)
+	{
+		omega->inputFd[index] = request.fd;
+	}
+	else
+	{
+		fprintf(stderr, "Could not request gpio input %u: %s\n", port, strerror(errno));
+	}
+}
+
+//request each chip's outputs as one handle, all low, once every pin has been requested
+bool omegaLineHoldPins(struct Backend *self)
+{
+	struct OmegaState *omega = self->state;
+	bool ok = true;
+	
+	for (int n = 0; n < omega->numChips; n++)
+	{
+		struct OmegaChip *chip = &omega->chips[n];
+		struct gpiohandle_request request;
+		
+		pthread_mutex_lock(&chip->lock);
+		
+		if (chip->numOutputs == 0 || chip->handleFd >= 0)
+		{
+			pthread_mutex_unlock(&chip->lock);
+			continue;
+		}
+		
+		memset(&request, 0, sizeof(request));
+		
+		for (int i = 0; i < chip->numOutputs; i++)
+		{
+			request.lineoffsets[i] = chip->outputs[i];
+			request.default_values[i] = chip->values[i];
+		}
+		
+		request.lines = chip->numOutputs;
+		request.flags = GPIOHANDLE_REQUEST_OUTPUT;
+		strcpy(request.consumer_label, "traffic");
+		
+		if (ioctl(chip->fd, GPIO_GET_LINEHANDLE_IOCTL, &request) == 0)
+		{
+			chip->handleFd = request.fd;
+		}
+		else
+		{
+			fprintf(stderr, "Could not request gpio outputs from line %u: %s\n", chip->base, strerror(errno));
+			ok = false;
+		}
+		
+		pthread_mutex_unlock(&chip->lock);
+	}
+	
+	return ok;
+}
+
+void omegaLineSetValue(struct Backend *self, const unsigned int port, int value)
+{
+	omegaLineSetValues(self, &port, &value, 1);
+}
+
+//one ioctl per chip touched; the lines of a chip change together
+void omegaLineSetValues(struct Backend *self, const unsigned int ports[], const int values[], int count)
+{
+	struct OmegaState *omega = self->state;
+	
+	for (int n = 0; n < omega->numChips; n++)
+	{
+		struct OmegaChip *chip = &omega->chips[n];
+		bool touched = false;
+		
+		//the handle sets every line it holds, so values and write must not interleave with another thread's
+		pthread_mutex_lock(&chip->lock);
+		
+		for (int i = 0; i < count; i++)
+		{
+			int slot = omega->outputSlot[ports[i] % 64];
+			
+			if (slot >= 0 && omegaChip(omega, ports[i]) == chip)
+			{
+				chip->values[slot] = values[i] != 0;
+				touched = true;
+			}
+		}
+		
+		if (touched && chip->handleFd >= 0)
+		{
+			struct gpiohandle_data data;
+			memcpy(data.values, chip->values, chip->numOutputs);
+			
+			//values keeps what was asked for; the next batch on this chip writes every line again
+			if (ioctl(chip->handleFd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) != 0)
+			{
+				int error = errno;
+				char tag[32];
+				snprintf(tag, sizeof(tag), "gpiochip%d", n);
+				writeToLog(date, logDegree, 24, tag, error);
+			}
+		}
+		
+		pthread_mutex_unlock(&chip->lock);
+	}
+}
+
+int omegaLineGetValue(struct Backend *self, const unsigned int port)
+{
+	struct OmegaState *omega = self->state;
+	int index = port % 64;
+	
+	if (omega->inputFd[index] >= 0)
+	{
+		struct gpiohandle_data data;
+		
+		if (ioctl(omega->inputFd[index], GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) != 0)
+		{
+			return -1;
+		}
+		
+		return data.values[0];
+	}
+	
+	if (omega->outputSlot[index] >= 0)
+	{
+		struct OmegaChip *chip = omegaChip(omega, port);
+		
+		pthread_mutex_lock(&chip->lock);
+		int value = chip->values[omega->outputSlot[index]];
+		pthread_mutex_unlock(&chip->lock);
+		
+		return value;
+	}
+	
+	return -1;
+}
+
+//throw away edges left over from the last sample; the kernel queues every edge from here on
+bool omegaLineArmEdge(struct Backend *self, const unsigned int port)
+{
+	struct OmegaState *omega = self->state;
+	int index = port % 64;
+	struct gpioevent_data events[16];
+	
+	if (!omega->inputEdges[index])
+	{
+		return false;
+	}
+	
+	while (read(omega->inputFd[index], events, sizeof(events)) > 0);
+	
+	return true;
+}
+
+bool omegaLineWaitEdge(struct Backend *self, const unsigned int port, int level, long long timeout, long long *timestamp)
+{
+	struct OmegaState *omega = self->state;
+	int fd = omega->inputFd[port % 64];
+	long long deadline = omegaNow(self) + timeout;
+	struct gpioevent_data event;
+	
+	while (true)
+	{
+		if (read(fd, &event, sizeof(event)) == sizeof(event))
+		{
+			if ((event.id == GPIOEVENT_EVENT_RISING_EDGE) != (level == 1))
+			{
+				continue;
+			}
+			
+			//the kernel stamps events on CLOCK_MONOTONIC since Linux 5.7 and on CLOCK_REALTIME before;
+			//its stamp is only used when it is on our clock
+			long long now = omegaNow(self);
+			long long stamp = event.timestamp;
+			
+			*timestamp = stamp <= now && now - stamp < 1000000000LL ? stamp : now;
+			return true;
+		}
+		
+		long long remaining = deadline - omegaNow(self);
+		
+		if (remaining <= 0)
+		{
+			return false;
+		}
+		
+		struct pollfd pfd = {fd, POLLIN, 0};
+		struct timespec wait = {remaining/1000000000LL, remaining%1000000000LL};
+		ppoll(&pfd, 1, &wait, NULL);
+	}
+}
+#endif
+
+bool omegaArmEdge(struct Backend *self, const unsigned int port)
+{
+	struct OmegaState *omega = self->state;
+	int *fd = &omega->valueFd[port % 64];
+	char path[64];
+	char value[4];
+	
+	if (*fd == -2)
+	{
+		return false;
+	}
+	
+	if (*fd == -1)
+	{
+		//interrupt on both edges of the exported gpio
+		snprintf(path, sizeof(path), "/sys/class/gpio/gpio%u/edge", port);
+		int edgeFd = open(path, O_WRONLY);
+		
+		if (edgeFd < 0 || write(edgeFd, "both", 4) != 4)
+		{
+			if (edgeFd >= 0)
+			{
+				close(edgeFd);
+			}
+			*fd = -2;
+			return false;
+		}
+		close(edgeFd);
+		
+		snprintf(path, sizeof(path), "/sys/class/gpio/gpio%u/value", port);
+		*fd = open(path, O_RDONLY);
+		
+		if (*fd < 0)
+		{
+			*fd = -2;
+			return false;
+		}
+	}
+	
+	//reading the value clears any edge still pending from the last sample
+	lseek(*fd, 0, SEEK_SET);
+	
+	return read(*fd, value, sizeof(value)) > 0;
+}
+
+bool omegaWaitEdge(struct Backend *self, const unsigned int port, int level, long long timeout, long long *timestamp)
+{
+	struct OmegaState *omega = self->state;
+	int fd = omega->valueFd[port % 64];
+	long long deadline = omegaNow(self) + timeout;
+	char value[4];
+	
+	while (true)
+	{
+		//read before polling so an edge between the two still wakes us up
+		lseek(fd, 0, SEEK_SET);
+		
+		if (read(fd, value, sizeof(value)) > 0 && (value[0] - '0') == level)
+		{
+			*timestamp = omegaNow(self);
+			return true;
+		}
+		
+		long long remaining = deadline - omegaNow(self);
+		
+		if (remaining <= 0)
+		{
+			return false;
+		}
+		
+		struct pollfd pfd = {fd, POLLPRI | POLLERR, 0};
+		struct timespec wait = {remaining/1000000000LL, remaining%1000000000LL};
+		ppoll(&pfd, 1, &wait, NULL);
+	}
+}
+
+long long omegaNow(struct Backend *self)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+void omegaSleepMicro(struct Backend *self, unsigned int microseconds)
+{
+	usleep(microseconds);
+}
+
+//sleep to an absolute monotonic deadline so time spent before the call doesn't shift the period
+void omegaSleepUntil(struct Backend *self, long long time)
+{
+	struct timespec deadline = {time/1000000000LL, time%1000000000LL};
+	
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+}
+
+struct Backend *createOmegaBackend()
+{
+#ifdef TRAFFIC_SIM_ONLY
+	return NULL;	//built without ugpio
+#else
+	struct Backend *omega = calloc(1, sizeof(struct Backend));
+	struct OmegaState *state = calloc(1, sizeof(struct OmegaState));
+	
+	for (int i = 0; i < 64; i++)
+	{
+		state->valueFd[i] = -1;
+		state->outputSlot[i] = -1;
+		state->inputFd[i] = -1;
+	}
+	
+	omega->name = "omega";
+	omega->state = state;
+	omega->now = omegaNow;
+	omega->sleepMicro = omegaSleepMicro;
+	omega->sleepUntil = omegaSleepUntil;
+	
+	//hold the lines through the gpio character devices where there are any, unless TRAFFIC_GPIO=sysfs
+	char *gpioInterface = getenv("TRAFFIC_GPIO");
+	state->chardev = (gpioInterface == NULL || strcmp(gpioInterface, "sysfs") != 0) && omegaOpenChips(state);
+	
+	if (state->chardev)
+	{
+		omega->requestPin = omegaLineRequestPin;
+		omega->holdPins = omegaLineHoldPins;
+		omega->setValue = omegaLineSetValue;
+		omega->setValues = omegaLineSetValues;
+		omega->getValue = omegaLineGetValue;
+		omega->armEdge = omegaLineArmEdge;
+		omega->waitEdge = omegaLineWaitEdge;
+	}
+	else
+	{
+		omega->requestPin = omegaRequestPin;
+		omega->setValue = omegaSetValue;
+		omega->getValue = omegaGetValue;
+		omega->armEdge = omegaArmEdge;
+		omega->waitEdge = omegaWaitEdge;
+	}
+	
+	return omega;
+#endif
+}
+
+//time until the next random arrival (exponential inter-arrival times)
+long long simNextGap(struct SimState *sim, double rate)
+{
+	if (rate <= 0)
+	{
+		return LLONG_MAX/2;
+	}
+	
+	double u = (rand_r(&sim->seed) + 1.0)/(RAND_MAX + 2.0);
+	
+	return -log(u)/rate*1e9;
+}
+
+//add the time every queued car spent waiting since the queue last changed
+void simAccumulateDelay(struct SimApproach *approach, long long until)
+{
+	approach->delay += approach->queue*((until - approach->lastQueueChange)/1e9);
+	approach->lastQueueChange = until;
+}
+
+//process arrivals and departures up to the current virtual time
+void simAdvance(struct SimState *sim)
+{
+	for (int i = 0; i < sim->numApproaches; i++)
+	{
+		struct SimApproach *approach = &sim->approaches[i];
+		
+		while (true)
+		{
+			bool green = sim->pins[approach->greenPort] != 0;
+			long long departure = LLONG_MAX;
+			
+			if (green && approach->queue > 0)
+			{
+				departure = approach->nextDeparture;
+			}
+			
+			//the next car is whichever comes first of the random arrivals and those handed over from upstream
+			long long arrival = approach->nextArrival;
+			bool handedOver = approach->inboundHead < approach->inboundSize && approach->inbound[approach->inboundHead] < arrival;
+			
+			if (handedOver)
+			{
+				arrival = approach->inbound[approach->inboundHead];
+			}
+			
+			if (arrival <= departure && arrival <= sim->clock)
+			{
+				simAccumulateDelay(approach, arrival);
+				approach->queue++;
+				approach->occupiedFrom = arrival;
+				approach->carRange = simCarRangeMin + (simCarRangeMax - simCarRangeMin)*rand_r(&sim->noiseSeed)/RAND_MAX;
+				
+				if (approach->nextDeparture < arrival)
+				{
+					approach->nextDeparture = arrival;
+				}
+				
+				if (handedOver)
+				{
+					approach->inboundHead++;
+				}
+				else
+				{
+					approach->nextArrival += simNextGap(sim, approach->arrivalRate);
+				}
+			}
+			else if (departure <= sim->clock)
+			{
+				simAccumulateDelay(approach, departure);
+				approach->queue--;
+				approach->departed++;
+				
+				if (approach->outbound != NULL)
+				{
+					if (approach->outboundSize == approach->outboundCapacity)
+					{
+						approach->outboundCapacity *= 2;
+						approach->outbound = realloc(approach->outbound, approach->outboundCapacity*sizeof(long long));
+					}
+					
+					approach->outbound[approach->outboundSize++] = departure;
+				}
+				approach->nextDeparture = departure + secondsToNanos(simHeadway);
+			}
+			else
+			{
+				break;
+			}
+		}
+	}
+}
+
+void simRequestPin(struct Backend *self, const unsigned int port, bool output)
+{
+	struct SimState *sim = self->state;
+	
+	sim->pins[port % 64] = 0;
+}
+
+void simSetValue(struct Backend *self, const unsigned int port, int value)
+{
+	struct SimState *sim = self->state;
+	
+	simAdvance(sim);	//settle the old light state before switching
+	
+	for (int i = 0; i < sim->numApproaches; i++)
+	{
+		struct SimApproach *approach = &sim->approaches[i];
+		
+		//queued cars start moving once the light turns green
+		if (approach->greenPort == port && value != 0 && approach->nextDeparture < sim->clock)
+		{
+			approach->nextDeparture = sim->clock;
+		}
+	}
+	
+	sim->pins[port % 64] = value;
+}
+
+int simGetValue(struct Backend *self, const unsigned int port)
+{
+	struct SimState *sim = self->state;
+	
+	return sim->pins[port % 64];
+}
+
+long long simNow(struct Backend *self)
+{
+	struct SimState *sim = self->state;
+	
+	return sim->clock;
+}
+
+void simSleepMicro(struct Backend *self, unsigned int microseconds)
+{
+	struct SimState *sim = self->state;
+	
+	sim->clock += microseconds*1000LL;		//virtual time, returns immediately
+}
+
+void simSleepUntil(struct Backend *self, long long time)
+{
+	struct SimState *sim = self->state;
+	
+	if (time > sim->clock)
+	{
+		sim->clock = time;
+	}
+}
+
+sensorRange simReadRange(struct Backend *self, const unsigned int gpioIn, const unsigned int gpioOut)
+{
+	struct SimState *sim = self->state;
+	
+	simAdvance(sim);
+	
+	for (int i = 0; i < sim->numApproaches; i++)
+	{
+		struct SimApproach *approach = &sim->approaches[i];
+		
+		if (approach->gpioIn == gpioIn)
+		{
+			if (sim->clock >= approach->occupiedFrom && sim->clock < approach->occupiedFrom + secondsToNanos(simOccupancy))
+			{
+				return RANGE_FROM_CM(approach->carRange);
+			}
+			
+			if (rand_r(&sim->noiseSeed) < simNoiseProbability*RAND_MAX)
+			{
+				return RANGE_FROM_CM(simEchoRangeMax*rand_r(&sim->noiseSeed)/RAND_MAX);
+			}
+			
+			return RANGE_FROM_CM(simNoCarRange);
+		}
+	}
+	
+	return -2;	//no sensor on this pin
+}
+
+//a sensor reads a car from its arrival until the occupancy time has passed, so nothing can change
+//between the end of one car and the arrival of the next
+long long simNextChange(struct Backend *self, const unsigned int gpioIn)
+{
+	struct SimState *sim = self->state;
+	
+	simAdvance(sim);
+	
+	for (int i = 0; i < sim->numApproaches; i++)
+	{
+		struct SimApproach *approach = &sim->approaches[i];
+		
+		if (approach->gpioIn != gpioIn)
+		{
+			continue;
+		}
+		
+		if (sim->clock < approach->occupiedFrom + secondsToNanos(simOccupancy))
+		{
+			return sim->clock;
+		}
+		
+		long long arrival = approach->nextArrival;
+		
+		if (approach->inboundHead < approach->inboundSize && approach->inbound[approach->inboundHead] < arrival)
+		{
+			arrival = approach->inbound[approach->inboundHead];
+		}
+		
+		return arrival;
+	}
+	
+	return sim->clock;
+}
+
+void simAddApproach(struct Backend *self, const unsigned int gpioIn, const unsigned int greenPort, float arrivalRate)
+{
+	struct SimState *sim = self->state;
+	
+	if (sim->numApproaches >= MAX_APPROACHES)
+	{
+		return;
+	}
+	
+	struct SimApproach *approach = &sim->approaches[sim->numApproaches];
+	approach->gpioIn = gpioIn;
+	approach->greenPort = greenPort % 64;
+	approach->arrivalRate = arrivalRate;
+	approach->queue = 0;
+	approach->nextArrival = sim->clock + simNextGap(sim, arrivalRate);
+	approach->nextDeparture = sim->clock;
+	approach->occupiedFrom = LLONG_MIN/2;
+	approach->carRange = simCarRangeMax;
+	approach->departed = 0;
+	approach->delay = 0;
+	approach->lastQueueChange = sim->clock;
+	
+	sim->numApproaches++;
+}
+
+//queue a car that reaches the approach's sensor at the given virtual time; times must not go backwards
+void simInjectArrival(struct Backend *self, int approachIndex, long long time)
+{
+	struct SimState *sim = self->state;
+	struct SimApproach *approach = &sim->approaches[approachIndex];
+	
+	//reuse the space of cars that already arrived
+	if (approach->inboundHead > 0 && approach->inboundHead == approach->inboundSize)
+	{
+		approach->inboundHead = 0;
+		approach->inboundSize = 0;
+	}
+	
+	if (approach->inboundSize == approach->inboundCapacity)
+	{
+		approach->inboundCapacity = approach->inboundCapacity > 0 ? approach->inboundCapacity*2 : 64;
+		approach->inbound = realloc(approach->inbound, approach->inboundCapacity*sizeof(long long));
+	}
+	
+	approach->inbound[approach->inboundSize++] = time;
+}
+
+//keep the departure time of every car leaving through the approach until simTakeDepartures collects them
+void simRecordDepartures(struct Backend *self, int approachIndex)
+{
+	struct SimState *sim = self->state;
+	struct SimApproach *approach = &sim->approaches[approachIndex];
+	
+	approach->outboundCapacity = 64;
+	approach->outboundSize = 0;
+	approach->outbound = malloc(approach->outboundCapacity*sizeof(long long));
+}
+
+//departures recorded since the last call; the array stays owned by the backend and is reused
+int simTakeDepartures(struct Backend *self, int approachIndex, long long **times)
+{
+	struct SimState *sim = self->state;
+	struct SimApproach *approach = &sim->approaches[approachIndex];
+	
+	simAdvance(sim);
+	
+	int count = approach->outboundSize;
+	*times = approach->outbound;
+	approach->outboundSize = 0;
+	
+	return count;
+}
+
+//seconds the average car spent queued, over every approach
+double simAverageDelay(struct Backend *self)
+{
+	struct SimState *sim = self->state;
+	double delay = 0;
+	int departed = 0;
+	
+	simAdvance(sim);
+	
+	for (int i = 0; i < sim->numApproaches; i++)
+	{
+		simAccumulateDelay(&sim->approaches[i], sim->clock);
+		delay += sim->approaches[i].delay;
+		departed += sim->approaches[i].departed;
+	}
+	
+	return departed > 0 ? delay/departed : 0;
+}
+
+//what actually happened on each simulated approach, to judge a strategy against
+void simReport(struct Backend *self, struct ReportBuffer *report)
+{
+	struct SimState *sim = self->state;
+	
+	simAdvance(sim);
+	
+	for (int i = 0; i < sim->numApproaches; i++)
+	{
+		struct SimApproach *approach = &sim->approaches[i];
+		
+		simAccumulateDelay(approach, sim->clock);
+		
+		reportPrintf(report, "Approach %d Cars Through: %d\r\n", i, approach->departed);
+		reportPrintf(report, "Approach %d Cars Still Queued: %d\r\n", i, approach->queue);
+		reportPrintf(report, "Approach %d Average Delay: %f s\r\n", i, approach->departed > 0 ? approach->delay/approach->departed : 0);
+	}
+}
+
+struct Backend *createSimBackend(unsigned int seed)
+{
+	struct Backend *simulated = calloc(1, sizeof(struct Backend));
+	struct SimState *sim = calloc(1, sizeof(struct SimState));
+	
+	sim->seed = seed;
+	sim->noiseSeed = seed ^ 0x5bd1e995;
+	
+	simulated->name = "sim";
+	simulated->state = sim;
+	simulated->virtualTime = true;
+	simulated->requestPin = simRequestPin;
+	simulated->setValue = simSetValue;
+	simulated->getValue = simGetValue;
+	simulated->now = simNow;
+	simulated->sleepMicro = simSleepMicro;
+	simulated->sleepUntil = simSleepUntil;
+	simulated->readRange = simReadRange;
+	simulated->addApproach = simAddApproach;
+	simulated->report = simReport;
+	simulated->nextChange = simNextChange;
+	
+	return simulated;
+}
+
+void destroySimBackend(struct Backend *simulated)
+{
+	struct SimState *sim = simulated->state;
+	
+	for (int i = 0; i < sim->numApproaches; i++)
+	{
+		free(sim->approaches[i].inbound);
+		free(sim->approaches[i].outbound);
+	}
+	
+	free(sim);
+	free(simulated);
+}
+
+//decode a whole trace into per-sensor arrays, so a replay reads it at memory speed
+struct Backend *createReplayBackend(const char *path)
+{
+	struct TraceReader reader;
+	
+	if (!openTraceReader(path, &reader))
+	{
+		return NULL;
+	}
+	
+	struct Backend *replayed = calloc(1, sizeof(struct Backend));
+	struct ReplayState *replay = calloc(1, sizeof(struct ReplayState));
+	int index;
+	struct RangeSample sample;
+	
+	replay->numSensors = reader.header->numSensors;
+	replay->start = LLONG_MAX;
+	
+	for (int i = 0; i < replay->numSensors; i++)
+	{
+		snprintf(replay->sensors[i].name, sizeof(replay->sensors[i].name), "%.15s", reader.header->names[i]);
+	}
+	
+	while (traceNext(&reader, &index, &sample))
+	{
+		struct ReplaySensor *sensor = &replay->sensors[index];
+		
+		if (sensor->count == sensor->capacity)
+		{
+			sensor->capacity = sensor->capacity > 0 ? sensor->capacity*2 : 4096;
+			sensor->times = realloc(sensor->times, sensor->capacity*sizeof(long long));
+			sensor->ranges = realloc(sensor->ranges, sensor->capacity*sizeof(sensorRange));
+		}
+		
+		//a sensor's readings were recorded in order; keep them so even if the clock was stepped
+		if (sensor->count > 0 && sample.timestamp < sensor->times[sensor->count - 1])
+		{
+			sample.timestamp = sensor->times[sensor->count - 1];
+		}
+		
+		sensor->times[sensor->count] = sample.timestamp;
+		sensor->ranges[sensor->count] = sample.range;
+		sensor->count++;
+		replay->readings++;
+	}
+	
+	closeTraceReader(&reader);
+	
+	for (int i = 0; i < replay->numSensors; i++)
+	{
+		struct ReplaySensor *sensor = &replay->sensors[i];
+		
+		if (sensor->count == 0)
+		{
+			continue;
+		}
+		
+		//walk backwards so every reading knows where the next different one is
+		sensor->nextChange = malloc(sensor->count*sizeof(int));
+		sensor->nextChange[sensor->count - 1] = sensor->count;
+		
+		for (int j = sensor->count - 2; j >= 0; j--)
+		{
+			sensor->nextChange[j] = sensor->ranges[j + 1] != sensor->ranges[j] ? j + 1 : sensor->nextChange[j + 1];
+		}
+		
+		if (sensor->times[0] < replay->start)
+		{
+			replay->start = sensor->times[0];
+		}
+		
+		if (sensor->times[sensor->count - 1] > replay->end)
+		{
+			replay->end = sensor->times[sensor->count - 1];
+		}
+	}
+	
+	if (replay->readings == 0)
+	{
+		free(replay);
+		free(replayed);
+		return NULL;
+	}
+	
+	//start early enough for the light test to end as the recorded readings begin
+	replay->start -= replay->numSensors*4000000000LL;
+	replay->clock = replay->start;
+	
+	replayed->name = "replay";
+	replayed->state = replay;
+	replayed->virtualTime = true;
+	replayed->requestPin = replayRequestPin;
+	replayed->setValue = replaySetValue;
+	replayed->getValue = replayGetValue;
+	replayed->now = replayNow;
+	replayed->sleepMicro = replaySleepMicro;
+	replayed->sleepUntil = replaySleepUntil;
+	replayed->readRange = replayReadRange;
+	replayed->addApproach = replayAddApproach;
+	replayed->nextChange = replayNextChange;
+	
+	return replayed;
+}
+
+void destroyReplayBackend(struct Backend *replayed)
+{
+	struct ReplayState *replay = replayed->state;
+	
+	for (int i = 0; i < replay->numSensors; i++)
+	{
+		free(replay->sensors[i].times);
+		free(replay->sensors[i].ranges);
+		free(replay->sensors[i].nextChange);
+	}
+	
+	free(replay);
+	free(replayed);
+}
+
+//put the trace's sensors in the order of the table's approaches, matched by name; false when an approach has none
+bool replayBindTable(struct Backend *self, struct PhaseTable *table)
+{
+	struct ReplayState *replay = self->state;
+	struct ReplaySensor sensors[MAX_APPROACHES];
+	int match[MAX_APPROACHES];
+	
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		match[i] = -1;
+		
+		for (int j = 0; j < replay->numSensors; j++)
+		{
+			if (strcmp(replay->sensors[j].name, table->approaches[i].name) == 0)
+			{
+				match[i] = j;
+			}
+		}
+		
+		if (match[i] < 0)
+		{
+			fprintf(stderr, "The trace has no sensor for approach %s\n", table->approaches[i].name);
+			return false;
+		}
+	}
+	
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		sensors[i] = replay->sensors[match[i]];
+		memset(&replay->sensors[match[i]], 0, sizeof(struct ReplaySensor));	//now owned by sensors[i]
+	}
+	
+	//sensors no approach reads are not replayed
+	for (int j = 0; j < replay->numSensors; j++)
+	{
+		free(replay->sensors[j].times);
+		free(replay->sensors[j].ranges);
+		free(replay->sensors[j].nextChange);
+	}
+	
+	memcpy(replay->sensors, sensors, table->numApproaches*sizeof(struct ReplaySensor));
+	replay->numSensors = table->numApproaches;
+	
+	return true;
+}
+
+//seconds from the start of the replay to the last recorded reading, rounded up
+int replayDuration(struct Backend *self)
+{
+	struct ReplayState *replay = self->state;
+	
+	return (replay->end - replay->start + 999999999LL)/1000000000LL;
+}
+
+struct ReplaySensor *replayFindSensor(struct ReplayState *replay, const unsigned int gpioIn)
+{
+	for (int i = 0; i < replay->numApproaches; i++)
+	{
+		struct ReplaySensor *sensor = &replay->sensors[i];
+		
+		if (sensor->gpioIn == gpioIn)
+		{
+			//the clock never goes back, so the cursor only moves forwards
+			while (sensor->cursor + 1 < sensor->count && sensor->times[sensor->cursor + 1] <= replay->clock)
+			{
+				sensor->cursor++;
+			}
+			
+			return sensor;
+		}
+	}
+	
+	return NULL;
+}
+
+void replayRequestPin(struct Backend *self, const unsigned int port, bool output)
+{
+	struct ReplayState *replay = self->state;
+	
+	replay->pins[port % 64] = 0;
+}
+
+void replaySetValue(struct Backend *self, const unsigned int port, int value)
+{
+	struct ReplayState *replay = self->state;
+	
+	replay->pins[port % 64] = value;
+}
+
+int replayGetValue(struct Backend *self, const unsigned int port)
+{
+	struct ReplayState *replay = self->state;
+	
+	return replay->pins[port % 64];
+}
+
+long long replayNow(struct Backend *self)
+{
+	struct ReplayState *replay = self->state;
+	
+	return replay->clock;
+}
+
+void replaySleepMicro(struct Backend *self, unsigned int microseconds)
+{
+	struct ReplayState *replay = self->state;
+	
+	replay->clock += microseconds*1000LL;
+}
+
+void replaySleepUntil(struct Backend *self, long long time)
+{
+	struct ReplayState *replay = self->state;
+	
+	if (time > replay->clock)
+	{
+		replay->clock = time;
+	}
+}
+
+//the last reading recorded at or before the clock; before the first one the first, after the last the last
+sensorRange replayReadRange(struct Backend *self, const unsigned int gpioIn, const unsigned int gpioOut)
+{
+	struct ReplayState *replay = self->state;
+	struct ReplaySensor *sensor = replayFindSensor(replay, gpioIn);
+	
+	if (sensor == NULL || sensor->count == 0)
+	{
+		return -2;	//no sensor on this pin
+	}
+	
+	return sensor->ranges[sensor->cursor];
+}
+
+void replayAddApproach(struct Backend *self, const unsigned int gpioIn, const unsigned int greenPort, float arrivalRate)
+{
+	struct ReplayState *replay = self->state;
+	
+	if (replay->numApproaches >= replay->numSensors)
+	{
+		return;
+	}
+	
+	replay->sensors[replay->numApproaches].gpioIn = gpioIn;
+	replay->numApproaches++;
+}
+
+//the reading holds until the next recorded one that differs
+long long replayNextChange(struct Backend *self, const unsigned int gpioIn)
+{
+	struct ReplayState *replay = self->state;
+	struct ReplaySensor *sensor = replayFindSensor(replay, gpioIn);
+	
+	if (sensor == NULL || sensor->count == 0)
+	{
+		return replay->clock;
+	}
+	
+	int next = sensor->nextChange[sensor->cursor];
+	
+	return next < sensor->count ? sensor->times[next] : replay->end;
+}
+
+bool light_on (const unsigned int port)
+{
+	LATENCY_START(start);
+	backend->setValue(backend, port, 1);  	//set gpio value to high
+	LATENCY_RECORD(LATENCY_GPIO_WRITE, start);
+	
+	return true;
+}
+
+bool light_off (const unsigned int port)
+{
+	LATENCY_START(start);
+	backend->setValue(backend, port, 0); 	//set gpio value to low
+	LATENCY_RECORD(LATENCY_GPIO_WRITE, start);
+	
+	return true;
+}
+
+void setPhaseLights (struct PhaseTable *table, struct Phase *phase)
+{
+	LATENCY_START(start);
+	
+	unsigned int ports[2*MAX_APPROACHES];
+	int values[2*MAX_APPROACHES];
+	int count = 0;
+	
+	//every approach that isn't in the phase turns red before any turns green, so conflicting greens never
+	//show together; an approach staying green is only set to what it already shows, so it never flickers
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		if (!(phase->greenMask & (1u << i)))
+		{
+			ports[count] = table->approaches[i].redPort;
+			values[count++] = 1;
+			ports[count] = table->approaches[i].greenPort;
+			values[count++] = 0;
+		}
+	}
+	
+	setLights(ports, values, count);
+	count = 0;
+	
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		if (phase->greenMask & (1u << i))
+		{
+			ports[count] = table->approaches[i].greenPort;
+			values[count++] = 1;
+			ports[count] = table->approaches[i].redPort;
+			values[count++] = 0;
+		}
+	}
+	
+	setLights(ports, values, count);
+	
+	LATENCY_RECORD(LATENCY_PHASE_SWITCH, start);
+}
+
+//several lights in one write per gpio chip where the backend can, otherwise one after the other
+void setLights (const unsigned int ports[], const int values[], int count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	
+	LATENCY_START(start);
+	
+	if (backend->setValues != NULL)
+	{
+		backend->setValues(backend, ports, values, count);
+	}
+	else
+	{
+		for (int i = 0; i < count; i++)
+		{
+			backend->setValue(backend, ports[i], values[i]);
+		}
+	}
+	
+	LATENCY_RECORD(LATENCY_GPIO_WRITE, start);
+}
+
+void defaultPhaseTable (struct PhaseTable *table)
+{
+	memset(table, 0, sizeof(struct PhaseTable));
+	
+	//the original two-approach intersection: north then west
+	struct Approach *north = &table->approaches[0];
+	strcpy(north->name, "North");
+	north->greenPort = GRN_N;
+	north->redPort = RED_N;
+	north->sensorIn = SENS_N_IN;
+	north->sensorOut = SENS_N_OUT;
+	north->arrivalRate = simArrivalRateN;
+	
+	struct Approach *west = &table->approaches[1];
+	strcpy(west->name, "West");
+	west->greenPort = GRN_W;
+	west->redPort = RED_W;
+	west->sensorIn = SENS_W_IN;
+	west->sensorOut = SENS_W_OUT;
+	west->arrivalRate = simArrivalRateW;
+	
+	table->numApproaches = 2;
+	
+	for (int i = 0; i < 2; i++)
+	{
+		table->phases[i].greenMask = 1u << i;
+		table->phases[i].minGreen = 0;
+		table->phases[i].maxGreen = defaultTimeInterval;
+		table->phases[i].gapOut = defaultGapOut;
+	}
+	
+	table->numPhases = 2;
+}
+
+//Phase table file, one entry per line ('#' starts a comment):
+//  approach <name> <green port> <red port> <echo port> <trigger port> [sim arrival rate in cars/s]
+//  phase <max green s> <min green s> <gap-out s> <approach name> [approach name...]
+//e.g. a protected left turn ahead of the through movement:
+//  approach North 18 46 2 19
+//  approach NorthLeft 15 16 17 11
+//  phase 15 5 4 NorthLeft
+//  phase 30 5 10 North
+//On the Omega2 the lights are written with one gpio write per chip, so a phase change is only atomic when
+//every red and green is on one chip (gpio 0-31 or 32-63). Lights over both chips still never show
+//conflicting greens, since all reds go on before any green, but a head may briefly show red and green,
+//or neither, between the two writes. The default table's north red on gpio 46 is such a case.
+bool loadPhaseTable (const char *filename, struct PhaseTable *table)
+{
+	FILE *fptr = fopen(filename, "r");
+	char line[256];
+	int lineNumber = 0;
+	const char *error = NULL;
+	
+	if (fptr == NULL)
+	{
+		return false;
+	}
+	
+	memset(table, 0, sizeof(struct PhaseTable));
+	
+	while (error == NULL && fgets(line, sizeof(line), fptr) != NULL)
+	{
+		char *comment = strchr(line, '#');
+		
+		lineNumber++;
+		
+		if (comment != NULL)
+		{
+			*comment = 0;
+		}
+		
+		char *keyword = strtok(line, " \t\r\n");
+		
+		if (keyword == NULL)
+		{
+			continue;
+		}
+		
+		if (strcmp(keyword, "approach") == 0)
+		{
+			struct Approach *approach = &table->approaches[table->numApproaches];
+			char *fields[6] = {0};
+			unsigned int pins[4];
+			
+			for (int i = 0; i < 6; i++)
+			{
+				fields[i] = strtok(NULL, " \t\r\n");
+			}
+			
+			if (table->numApproaches == MAX_APPROACHES)
+			{
+				error = "more approaches than MAX_APPROACHES";
+				continue;
+			}
+			
+			if (fields[4] == NULL)
+			{
+				error = "an approach needs a name and four pins";
+				continue;
+			}
+			
+			//the backends keep per-pin state in 64 slots, so a pin must fit one and not share it
+			for (int i = 0; i < 4 && error == NULL; i++)
+			{
+				char *end;
+				long pin = strtol(fields[i + 1], &end, 10);
+				
+				if (*end != 0 || pin < 0 || pin >= 64)
+				{
+					error = "pins must be numbers from 0 to 63";
+				}
+				
+				pins[i] = pin;
+				
+				for (int j = 0; j < i && error == NULL; j++)
+				{
+					if (pins[j] == pins[i])
+					{
+						error = "an approach uses the same pin twice";
+					}
+				}
+				
+				for (int a = 0; a < table->numApproaches && error == NULL; a++)
+				{
+					struct Approach *other = &table->approaches[a];
+					
+					if (pins[i] == other->greenPort || pins[i] == other->redPort || pins[i] == other->sensorIn || pins[i] == other->sensorOut)
+					{
+						error = "pin already used by an earlier approach";
+					}
+				}
+			}
+			
+			if (error != NULL)
+			{
+				continue;
+			}
+			
+			strncpy(approach->name, fields[0], sizeof(approach->name) - 1);
+			approach->greenPort = pins[0];
+			approach->redPort = pins[1];
+			approach->sensorIn = pins[2];
+			approach->sensorOut = pins[3];
+			approach->arrivalRate = fields[5] != NULL ? atof(fields[5]) : simArrivalRateTable;
+			
+			table->numApproaches++;
+		}
+		else if (strcmp(keyword, "phase") == 0)
+		{
+			struct Phase *phase = &table->phases[table->numPhases];
+			char *maxGreen = strtok(NULL, " \t\r\n");
+			char *minGreen = strtok(NULL, " \t\r\n");
+			char *gapOut = strtok(NULL, " \t\r\n");
+			char *name;
+			
+			if (table->numPhases == MAX_PHASES)
+			{
+				error = "more phases than MAX_PHASES";
+				continue;
+			}
+			
+			if (gapOut == NULL)
+			{
+				error = "a phase needs max green, min green and gap-out";
+				continue;
+			}
+			
+			phase->maxGreen = atof(maxGreen);
+			phase->minGreen = atof(minGreen);
+			phase->gapOut = atof(gapOut);
+			
+			while (error == NULL && (name = strtok(NULL, " \t\r\n")) != NULL)
+			{
+				int index = findApproach(table, name);
+				
+				if (index < 0)
+				{
+					error = "phases may only name approaches declared above them";
+				}
+				else
+				{
+					phase->greenMask |= 1u << index;
+				}
+			}
+			
+			table->numPhases++;
+		}
+		else
+		{
+			error = "unknown keyword";
+		}
+	}
+	
+	fclose(fptr);
+	
+	if (error != NULL)
+	{
+		fprintf(stderr, "%s:%d: %s\n", filename, lineNumber, error);
+		return false;
+	}
+	
+	return table->numApproaches > 0 && table->numPhases > 0;
+}
+
+int findApproach (struct PhaseTable *table, const char *name)
+{
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		if (strcmp(table->approaches[i].name, name) == 0)
+		{
+			return i;
+		}
+	}
+	
+	return -1;
+}
+
+int deltaTime(const int oldTime)
+{
+	int currentTime = timeUpdate(); 		//take the time in seconds
+	int change = currentTime - oldTime; 	//calculate the change in time
+	
+	return change;
+}
+
+int timeUpdate()
+{
+	long long now = backend->now(backend);	//get current time
+
+	int newTime = now/1000000000LL;
+	return newTime;			//return the current time
+}
+
+//sleep until the backend clock reaches the given time
+void sleepUntil(long long time)
+{
+	if (backend->sleepUntil != NULL)
+	{
+		backend->sleepUntil(backend, time);
+		return;
+	}
+	
+	long long remaining = time - backend->now(backend);
+	
+	if (remaining > 0)
+	{
+		backend->sleepMicro(backend, (remaining + 999)/1000);
+	}
+}
+
+int minutesToSeconds(int minutes)
+{
+	return minutes*60;
+}
+
+long long secondsToNanos(float seconds)
+{
+	return llroundf(seconds*1e6f)*1000LL;	//rounded to whole microseconds
+}
+
+sensorRange readSensor (const unsigned int gpioIn, const unsigned int gpioOut)
+{
+	LATENCY_START(start);
+	
+	//backends without real echo timing report the range directly
+	if (backend->readRange != NULL)
+	{
+		sensorRange range = backend->readRange(backend, gpioIn, gpioOut);
+		LATENCY_RECORD(LATENCY_READ_SENSOR, start);
+		
+		return range;
+	}
+	
+	sensorRange detectedRange = 0;
+	long long riseTime = 0;
+	long long fallTime = 0;
+	
+	//gpioIn (Echo) and gpioOut (Trig) were requested once at startup
+	//arm edge capture before triggering so the rising edge can't be missed
+	bool edges = backend->armEdge != NULL && backend->armEdge(backend, gpioIn);
+	
+	//Trigger Sensor
+	LATENCY_START(triggerStart);
+	backend->setValue(backend, gpioOut, 1);
+	LATENCY_RECORD(LATENCY_GPIO_WRITE, triggerStart);
+	backend->sleepMicro(backend, 15);
+	backend->setValue(backend, gpioOut, 0);
+	
+	//sensor didn't work
+	if (!waitForEcho(gpioIn, 1, echoStartTimeout, edges, &riseTime))
+	{
+		detectedRange = -2;
+	}
+	//detected nothing
+	else if (!waitForEcho(gpioIn, 0, echoMaxWidth, edges, &fallTime))
+	{
+		detectedRange = -1;
+	}
+	//find the range in centimeters from the measured pulse width, 58 us per cm
+	else
+	{
+#ifdef TRAFFIC_FIXED_POINT
+		detectedRange = (sensorRange)((fallTime - riseTime)/580);	//whole hundredths of a cm, no float at all
+#else
+		detectedRange = (fallTime - riseTime)/1000.0f/58;
+#endif
+	}
+	
+	LATENCY_RECORD(LATENCY_READ_SENSOR, start);
+
+	return detectedRange;
+
+}
+
+bool waitForEcho(const unsigned int gpioIn, int level, long long timeout, bool edges, long long *timestamp)
+{
+	LATENCY_START(waitStart);
+	
+	if (edges)
+	{
+		bool seen = backend->waitEdge(backend, gpioIn, level, timeout, timestamp);
+		LATENCY_RECORD(LATENCY_ECHO_WAIT, waitStart);
+		
+		return seen;
+	}
+	
+	//no edge events: poll the pin and timestamp with the monotonic clock
+	long long start = backend->now(backend);
+	
+	while (backend->getValue(backend, gpioIn) != level)
+	{
+		if (backend->now(backend) - start >= timeout)
+		{
+			LATENCY_RECORD(LATENCY_ECHO_WAIT, waitStart);
+			return false;
+		}
+		
+		backend->sleepMicro(backend, 1);
+	}
+	
+	*timestamp = backend->now(backend);
+	LATENCY_RECORD(LATENCY_ECHO_WAIT, waitStart);
+	
+	return true;
+}
+
+bool carPassed(const unsigned int gpioIn, const unsigned int gpioOut, const float threshold)
+{
+	if (readSensor(gpioIn, gpioOut) <= RANGE_FROM_CM(threshold)) //if sensor output is less than threshold
+	{
+		return true;	//car has passed
+	}
+	else
+	{
+		return false;	//no car
+	}
+}
+
+void controllerInit (struct Controller *ctrl, struct PhaseTable *table, const struct ControlStrategy *strategy, struct Sampler *samplers, bool threadedSampling)
+{
+	memset(ctrl, 0, sizeof(struct Controller));
+	ctrl->table = table;
+	ctrl->strategy = strategy;
+	ctrl->samplers = samplers;
+	ctrl->threadedSampling = threadedSampling;
+	ctrl->currentPhase = 0;
+	ctrl->phaseActive = false;
+	ctrl->runStart = backend->now(backend);
+	ctrl->lastDemandUpdate = ctrl->runStart;
+	ctrl->deadline = -1;
+	
+	//samplers without a thread of their own are sampled by the controller's events
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		initDetector(&ctrl->detectors[i], samplers[i].threshold);
+		
+		if (!samplers[i].threaded)
+		{
+			eventPush(&ctrl->events, (struct Event){ctrl->runStart, EVENT_SAMPLE, i});
+		}
+	}
+}
+
+//Handle the controller's next event: wait until it is due, sample or decide, then schedule what
+//follows. Returns true when the running phase ended.
+bool controllerStep (struct Controller *ctrl)
+{
+	struct Event event;
+	
+	if (!ctrl->phaseActive)
+	{
+		controllerStartPhase(ctrl);
+		controllerSchedule(ctrl);
+	}
+	
+	if (!eventPop(&ctrl->events, &event))
+	{
+		return false;
+	}
+	
+	sleepUntil(event.time);
+	
+	long long lateness = backend->now(backend) - event.time;
+	recordLateness(&ctrl->timing, lateness, lateness > latenessBudget);
+	
+	if (event.type == EVENT_SAMPLE)
+	{
+		sampleSensor(&ctrl->samplers[event.index]);
+	}
+	else if (event.time != ctrl->deadline)
+	{
+		return false;	//a decision that was rescheduled since
+	}
+	else
+	{
+		ctrl->deadline = -1;
+	}
+	
+	controllerCollect(ctrl);
+	
+	if (event.type == EVENT_SAMPLE)
+	{
+		//sample again after the sample period, or, once the detector has settled, not until the backend
+		//says the reading can change
+		long long next = event.time + samplePeriod*1000LL;
+		
+		if (backend->nextChange != NULL && detectorSettled(&ctrl->detectors[event.index]))
+		{
+			long long change = backend->nextChange(backend, ctrl->samplers[event.index].sensorIn);
+			
+			if (change > next)
+			{
+				next = change;
+			}
+		}
+		
+		eventPush(&ctrl->events, (struct Event){next, EVENT_SAMPLE, event.index});
+	}
+	
+	long long now = backend->now(backend);
+	float timeInterval = 0;
+	
+	if (ctrl->strategy->phaseDone(ctrl, (now - ctrl->timerMain)/1e9, (now - ctrl->timerOpti)/1e9, &timeInterval))
+	{
+		controllerEndPhase(ctrl, timeInterval);
+		publishMetrics(ctrl);
+		return true;
+	}
+	
+	controllerSchedule(ctrl);
+	publishMetrics(ctrl);
+	
+	return false;
+}
+
+//take in what every sampler has seen since the last event
+void controllerCollect (struct Controller *ctrl)
+{
+	struct PhaseTable *table = ctrl->table;
+	struct Phase *phase = &table->phases[ctrl->currentPhase];
+	struct RangeSample samples[DETECTOR_BLOCK];
+	struct VehicleEvent events[DETECTOR_BLOCK];
+	long long now = backend->now(backend);
+	float elapsed = (now - ctrl->lastDemandUpdate)/1e9;
+	
+	ctrl->lastDemandUpdate = now;
+	
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		//green approaches discharge their queue at the saturation flow
+		if (phase->greenMask & (1u << i))
+		{
+			ctrl->demand[i] -= elapsed/saturationHeadway;
+			
+			if (ctrl->demand[i] < 0)
+			{
+				ctrl->demand[i] = 0;
+			}
+		}
+		
+		//filter the readings a block at a time; only whole vehicles come out
+		int numSamples;
+		
+		do
+		{
+			numSamples = 0;
+			
+			while (numSamples < DETECTOR_BLOCK && popSample(&ctrl->samplers[i].queue, &samples[numSamples]))
+			{
+				if (ctrl->trace != NULL)
+				{
+					traceRecord(ctrl->trace, i, samples[numSamples]);
+				}
+				
+				numSamples++;
+			}
+			
+			int numEvents = detectorProcess(&ctrl->detectors[i], samples, numSamples, events);
+			
+			for (int e = 0; e < numEvents; e++)
+			{
+				if (!events[e].arrival)
+				{
+					writeToLog(date, logDegree, 17, table->approaches[i].name, events[e].occupancy);
+					continue;
+				}
+				
+				ctrl->arrivals[i]++;
+				ctrl->demand[i]++;
+				
+				if (phase->greenMask & (1u << i))
+				{
+					ctrl->carCounter[i]++;
+					writeToLog(date, logDegree, 8, 0, 0);
+					ctrl->timerOpti = events[e].timestamp;
+				}
+				else
+				{
+					table->approaches[i].waiting++;
+				}
+			}
+		}
+		while (numSamples == DETECTOR_BLOCK);
+	}
+}
+
+//make sure a decision event is pending for when the strategy next needs to look at the phase
+void controllerSchedule (struct Controller *ctrl)
+{
+	long long deadline = ctrl->strategy->nextDecision(ctrl);
+	long long now = backend->now(backend);
+	
+	//never decide in the past, or the same moment would be decided forever
+	if (deadline <= now)
+	{
+		deadline = now + 1000000;
+	}
+	
+	//readings from sampler threads only reach the detectors when the controller collects them
+	if (ctrl->threadedSampling && deadline > now + secondsToNanos(collectPeriod))
+	{
+		deadline = now + secondsToNanos(collectPeriod);
+	}
+	
+	if (deadline != ctrl->deadline)
+	{
+		ctrl->deadline = deadline;
+		eventPush(&ctrl->events, (struct Event){deadline, EVENT_DECISION, 0});
+	}
+}
+
+//when the controller's next event is due; now if a phase has to be started first
+long long controllerNextEvent (struct Controller *ctrl)
+{
+	if (!ctrl->phaseActive || ctrl->events.size == 0)
+	{
+		return backend->now(backend);
+	}
+	
+	return ctrl->events.heap[0].time;
+}
+
+void freeController (struct Controller *ctrl)
+{
+	free(ctrl->events.heap);
+	ctrl->events.heap = NULL;
+}
+
+void eventPush (struct EventQueue *queue, struct Event event)
+{
+	if (queue->size == queue->capacity)
+	{
+		queue->capacity = queue->capacity > 0 ? queue->capacity*2 : 16;
+		queue->heap = realloc(queue->heap, queue->capacity*sizeof(struct Event));
+	}
+	
+	//sift up
+	int i = queue->size++;
+	
+	while (i > 0 && queue->heap[(i - 1)/2].time > event.time)
+	{
+		queue->heap[i] = queue->heap[(i - 1)/2];
+		i = (i - 1)/2;
+	}
+	
+	queue->heap[i] = event;
+}
+
+bool eventPop (struct EventQueue *queue, struct Event *event)
+{
+	if (queue->size == 0)
+	{
+		return false;
+	}
+	
+	*event = queue->heap[0];
+	
+	//sift the last event down from the root
+	struct Event last = queue->heap[--queue->size];
+	int i = 0;
+	
+	while (true)
+	{
+		int child = 2*i + 1;
+		
+		if (child >= queue->size)
+		{
+			break;
+		}
+		
+		if (child + 1 < queue->size && queue->heap[child + 1].time < queue->heap[child].time)
+		{
+			child++;
+		}
+		
+		if (last.time <= queue->heap[child].time)
+		{
+			break;
+		}
+		
+		queue->heap[i] = queue->heap[child];
+		i = child;
+	}
+	
+	queue->heap[i] = last;
+	
+	return true;
+}
+
+void controllerStartPhase (struct Controller *ctrl)
+{
+	struct PhaseTable *table = ctrl->table;
+	struct Phase *phase = &table->phases[ctrl->currentPhase];
+	
+	setPhaseLights(table, phase);
+	
+	//demand that built up while these approaches were red
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		if (phase->greenMask & (1u << i))
+		{
+			writeToLog(date, logDegree, 16, table->approaches[i].name, table->approaches[i].waiting);
+			table->approaches[i].waiting = 0;
+		}
+	}
+	
+	ctrl->timerMain = backend->now(backend);
+	ctrl->timerOpti = ctrl->timerMain;
+	memset(ctrl->carCounter, 0, sizeof(ctrl->carCounter));
+	ctrl->phaseActive = true;
+	
+	if (ctrl->strategy->startPhase != NULL)
+	{
+		ctrl->strategy->startPhase(ctrl);
+	}
+}
+
+void controllerEndPhase (struct Controller *ctrl, float timeInterval)
+{
+	struct PhaseTable *table = ctrl->table;
+	struct Phase *phase = &table->phases[ctrl->currentPhase];
+	struct StatsOverInterval intervalStat;
+	
+	intervalStat.timeInterval = TIME_FROM_SECONDS(timeInterval);
+	
+	//record the interval for every approach that was green
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		struct Approach *approach = &table->approaches[i];
+		
+		if (!(phase->greenMask & (1u << i)))
+		{
+			continue;
+		}
+		
+		intervalStat.numCars = ctrl->carCounter[i];
+		intervalStat.startTime = ctrl->timerMain;
+		intervalStat.cps = calcCarsPerSecond(intervalStat);
+		ctrl->lastCPS[i] = CPS_TO_FLOAT(intervalStat.cps);
+		accumulateInterval(&approach->stats, intervalStat);
+		
+		if (!intervalStorePush(&approach->intervals, intervalStat) && approach->intervals.dropped == 1)
+		{
+			writeToLog(date, logDegree, 15, approach->name, approach->intervals.size);
+		}
+		
+		if (ctrl->journal != NULL)
+		{
+			journalAppend(ctrl->journal, i, intervalStat);
+		}
+		
+		if (ctrl->windows != NULL)
+		{
+			windowAdd(&ctrl->windows[i], intervalStat, backend->now(backend)/60000000000LL);
+		}
+		
+		//Log appropriate interval information
+		writeToLog(date, logDegree, 4, approach->name, phase->maxGreen - timeInterval);
+		writeToLog(date, logDegree, 5, approach->name, timeInterval);
+		writeToLog(date, logDegree, 14, approach->name, ctrl->carCounter[i]);
+		writeToLog(date, logDegree, 6, approach->name, ctrl->lastCPS[i]);
+	}
+	
+	ctrl->currentPhase = ctrl->strategy->nextPhase(ctrl);
+	ctrl->phaseActive = false;
+}
+
+//run the controller's events up to the given time, without waiting for the running phase
+void controllerRunUntil (struct Controller *ctrl, long long until)
+{
+	while (controllerNextEvent(ctrl) < until)
+	{
+		controllerStep(ctrl);
+	}
+	
+	sleepUntil(until);
+}
+
+const struct ControlStrategy *findStrategy (const char *name)
+{
+	for (int i = 0; i < numStrategies; i++)
+	{
+		if (strcmp(strategies[i].name, name) == 0)
+		{
+			return &strategies[i];
+		}
+	}
+	
+	return NULL;
+}
+
+bool gapOutPhaseDone (struct Controller *ctrl, float elapsed, float sinceLastCar, float *timeInterval)
+{
+	struct Phase *phase = &ctrl->table->phases[ctrl->currentPhase];
+	
+	if (elapsed >= phase->maxGreen)
+	{
+		*timeInterval = phase->maxGreen;
+		return true;
+	}
+	else if (elapsed >= phase->minGreen && sinceLastCar >= phase->gapOut)
+	{
+		*timeInterval = elapsed;
+		return true;
+	}
+	
+	return false;
+}
+
+bool fixedPhaseDone (struct Controller *ctrl, float elapsed, float sinceLastCar, float *timeInterval)
+{
+	struct Phase *phase = &ctrl->table->phases[ctrl->currentPhase];
+	
+	if (elapsed >= phase->maxGreen)
+	{
+		*timeInterval = phase->maxGreen;
+		return true;
+	}
+	
+	return false;
+}
+
+bool maxPressurePhaseDone (struct Controller *ctrl, float elapsed, float sinceLastCar, float *timeInterval)
+{
+	struct Phase *phase = &ctrl->table->phases[ctrl->currentPhase];
+	
+	if (elapsed >= phase->maxGreen)
+	{
+		*timeInterval = phase->maxGreen;
+		return true;
+	}
+	
+	if (elapsed < phase->minGreen || elapsed < pressureMinGreen)
+	{
+		return false;
+	}
+	
+	//switch once another phase has more cars queued than this one
+	float pressure = phasePressure(ctrl, ctrl->currentPhase);
+	
+	for (int p = 0; p < ctrl->table->numPhases; p++)
+	{
+		if (p != ctrl->currentPhase && phasePressure(ctrl, p) > pressure)
+		{
+			*timeInterval = elapsed;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+void websterStartPhase (struct Controller *ctrl)
+{
+	struct PhaseTable *table = ctrl->table;
+	struct Phase *phase = &table->phases[ctrl->currentPhase];
+	float runTime = (backend->now(backend) - ctrl->runStart)/1e9;
+	float flowRatio[MAX_PHASES];
+	float totalRatio = 0;
+	
+	//flow ratio of a phase: measured arrival rate of its busiest approach over the saturation flow
+	for (int p = 0; p < table->numPhases; p++)
+	{
+		flowRatio[p] = 0;
+		
+		for (int i = 0; i < table->numApproaches; i++)
+		{
+			if ((table->phases[p].greenMask & (1u << i)) && runTime > 0)
+			{
+				float ratio = ctrl->arrivals[i]/runTime*saturationHeadway;
+				
+				if (ratio > flowRatio[p])
+				{
+					flowRatio[p] = ratio;
+				}
+			}
+		}
+		
+		totalRatio += flowRatio[p];
+	}
+	
+	//Webster's optimum cycle C = (1.5L + 5)/(1 - Y), green shared in proportion to the flow ratios
+	float lostTime = websterLostTime*table->numPhases;
+	float cycle = websterMaxCycle;
+	
+	if (totalRatio < 0.95)
+	{
+		cycle = (1.5*lostTime + 5)/(1 - totalRatio);
+	}
+	
+	if (cycle > websterMaxCycle)
+	{
+		cycle = websterMaxCycle;
+	}
+	
+	if (totalRatio > 0)
+	{
+		ctrl->greenTarget = (cycle - lostTime)*flowRatio[ctrl->currentPhase]/totalRatio;
+	}
+	else
+	{
+		ctrl->greenTarget = phase->maxGreen;	//nothing measured yet
+	}
+	
+	if (ctrl->greenTarget < phase->minGreen)
+	{
+		ctrl->greenTarget = phase->minGreen;
+	}
+	
+	if (ctrl->greenTarget > phase->maxGreen)
+	{
+		ctrl->greenTarget = phase->maxGreen;
+	}
+}
+
+bool websterPhaseDone (struct Controller *ctrl, float elapsed, float sinceLastCar, float *timeInterval)
+{
+	if (elapsed >= ctrl->greenTarget)
+	{
+		*timeInterval = elapsed;
+		return true;
+	}
+	
+	return false;
+}
+
+//max green, or the gap-out once min green is over, whichever comes first
+long long gapOutNextDecision (struct Controller *ctrl)
+{
+	struct Phase *phase = &ctrl->table->phases[ctrl->currentPhase];
+	long long maximum = ctrl->timerMain + secondsToNanos(phase->maxGreen);
+	long long gap = ctrl->timerOpti + secondsToNanos(phase->gapOut);
+	long long minimum = ctrl->timerMain + secondsToNanos(phase->minGreen);
+	long long gapOut = gap > minimum ? gap : minimum;
+	
+	return gapOut < maximum ? gapOut : maximum;
+}
+
+long long fixedNextDecision (struct Controller *ctrl)
+{
+	return ctrl->timerMain + secondsToNanos(ctrl->table->phases[ctrl->currentPhase].maxGreen);
+}
+
+//queues keep changing, so look again every check period once the phase may end
+long long maxPressureNextDecision (struct Controller *ctrl)
+{
+	struct Phase *phase = &ctrl->table->phases[ctrl->currentPhase];
+	long long maximum = ctrl->timerMain + secondsToNanos(phase->maxGreen);
+	long long next = ctrl->timerMain + secondsToNanos(phase->minGreen > pressureMinGreen ? phase->minGreen : pressureMinGreen);
+	long long check = backend->now(backend) + secondsToNanos(pressureCheckPeriod);
+	
+	if (check > next)
+	{
+		next = check;
+	}
+	
+	return next < maximum ? next : maximum;
+}
+
+long long websterNextDecision (struct Controller *ctrl)
+{
+	return ctrl->timerMain + secondsToNanos(ctrl->greenTarget);
+}
+
+int cyclicNextPhase (struct Controller *ctrl)
+{
+	return (ctrl->currentPhase + 1) % ctrl->table->numPhases;
+}
+
+int maxPressureNextPhase (struct Controller *ctrl)
+{
+	int best = cyclicNextPhase(ctrl);
+	float bestPressure = phasePressure(ctrl, best);
+	
+	//look in cycle order so ties go to the phase that has waited longest
+	for (int step = 2; step < ctrl->table->numPhases; step++)
+	{
+		int p = (ctrl->currentPhase + step) % ctrl->table->numPhases;
+		float pressure = phasePressure(ctrl, p);
+		
+		if (pressure > bestPressure)
+		{
+			best = p;
+			bestPressure = pressure;
+		}
+	}
+	
+	return best;
+}
+
+float phasePressure (struct Controller *ctrl, int phase)
+{
+	float pressure = 0;
+	
+	for (int i = 0; i < ctrl->table->numApproaches; i++)
+	{
+		if (ctrl->table->phases[phase].greenMask & (1u << i))
+		{
+			pressure += ctrl->demand[i];
+		}
+	}
+	
+	return pressure;
+}
+
+void startSamplers (struct Sampler samplers[], struct PhaseTable *table, float threshold, bool threaded)
+{
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		struct Sampler *sampler = &samplers[i];
+		
+		memset(sampler, 0, sizeof(struct Sampler));
+		sampler->sensorIn = table->approaches[i].sensorIn;
+		sampler->sensorOut = table->approaches[i].sensorOut;
+		sampler->threshold = threshold;
+		sampler->threaded = threaded;
+		sampler->backend = backend;
+		atomic_init(&sampler->queue.head, 0);
+		atomic_init(&sampler->queue.tail, 0);
+		atomic_init(&sampler->queue.dropped, 0);
+		atomic_init(&sampler->running, true);
+		
+		if (threaded && pthread_create(&sampler->thread, NULL, samplerThread, sampler) != 0)
+		{
+			sampler->threaded = false;	//no thread; sampled from the control loop instead
+		}
+	}
+}
+
+void stopSamplers (struct Sampler samplers[], int numSamplers)
+{
+	for (int i = 0; i < numSamplers; i++)
+	{
+		atomic_store(&samplers[i].running, false);
+	}
+	
+	for (int i = 0; i < numSamplers; i++)
+	{
+		if (samplers[i].threaded)
+		{
+			pthread_join(samplers[i].thread, NULL);
+		}
+	}
+}
+
+void recordLateness (struct TimingStats *timing, long long lateness, bool missed)
+{
+	timing->count++;
+	
+	if (missed)
+	{
+		timing->missed++;
+	}
+	
+	if (lateness > timing->maxLateness)
+	{
+		timing->maxLateness = lateness;
+	}
+	
+	double delta = lateness - timing->meanLateness;
+	timing->meanLateness += delta/timing->count;
+	timing->m2Lateness += delta*(lateness - timing->meanLateness);
+}
+
+void *samplerThread (void *arg)
+{
+	struct Sampler *sampler = arg;
+	backend = sampler->backend;
+	long long period = samplePeriod*1000LL;
+	long long deadline = backend->now(backend);
+	
+	//samples are due on a fixed grid of periods, however long each reading takes
+	while (atomic_load_explicit(&sampler->running, memory_order_relaxed))
+	{
+		sleepUntil(deadline);
+		
+		long long start = backend->now(backend);
+		
+		sampleSensor(sampler);
+		
+		//a reading that runs past the next deadline misses it; skip to the next slot on the grid
+		long long finish = backend->now(backend);
+		bool missed = finish > deadline + period;
+		
+		recordLateness(&sampler->timing, start - deadline, missed);
+		deadline += period;
+		
+		if (missed)
+		{
+			deadline += (finish - deadline)/period*period + period;
+		}
+	}
+	
+	return NULL;
+}
+
+//every reading goes to the control loop; deciding what is a car is the detector's job
+void sampleSensor (struct Sampler *sampler)
+{
+	struct RangeSample sample = {0, readSensor(sampler->sensorIn, sampler->sensorOut)};
+	sample.timestamp = backend->now(backend);
+	
+	if (!pushSample(&sampler->queue, sample))
+	{
+		atomic_fetch_add_explicit(&sampler->queue.dropped, 1, memory_order_relaxed);
+	}
+}
+
+bool pushSample (struct SampleQueue *queue, struct RangeSample sample)
+{
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+	
+	if (head - tail >= SAMPLE_QUEUE_SIZE)
+	{
+		return false;
+	}
+	
+	queue->samples[head % SAMPLE_QUEUE_SIZE] = sample;
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+	
+	return true;
+}
+
+bool popSample (struct SampleQueue *queue, struct RangeSample *sample)
+{
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+	
+	if (tail == head)
+	{
+		return false;
+	}
+	
+	*sample = queue->samples[tail % SAMPLE_QUEUE_SIZE];
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+	
+	return true;
+}
+
+void initDetector (struct Detector *detector, float threshold)
+{
+	memset(detector, 0, sizeof(struct Detector));
+	detector->enterThreshold = RANGE_FROM_CM(threshold);
+	detector->exitThreshold = RANGE_FROM_CM(threshold*detectionHysteresis);
+	detector->lastValid = RANGE_FROM_CM(noEchoRange);
+	
+	//start out as if the road had been clear
+	for (int i = 0; i < MEDIAN_WINDOW - 1; i++)
+	{
+		detector->history[i] = RANGE_FROM_CM(noEchoRange);
+	}
+}
+
+//Filter a block of readings and write out the vehicle events they contain; returns how many.
+//events needs room for numSamples events.
+int detectorProcess (struct Detector *detector, struct RangeSample samples[], int numSamples, struct VehicleEvent events[])
+{
+	sensorRange input[DETECTOR_BLOCK + MEDIAN_WINDOW - 1];
+	long long times[DETECTOR_BLOCK + MEDIAN_WINDOW - 1];
+	sensorRange median[DETECTOR_BLOCK];
+	int numEvents = 0;
+	
+	for (int start = 0; start < numSamples; start += DETECTOR_BLOCK)
+	{
+		int count = numSamples - start < DETECTOR_BLOCK ? numSamples - start : DETECTOR_BLOCK;
+		
+		//the tail of the last block leads into this one
+		memcpy(input, detector->history, sizeof(detector->history));
+		memcpy(times, detector->historyTime, sizeof(detector->historyTime));
+		
+		for (int i = 0; i < count; i++)
+		{
+			sensorRange range = samples[start + i].range;
+			
+			//no echo means nothing in range; no answer at all tells us nothing, so hold the last reading
+			if (range == -1)
+			{
+				range = RANGE_FROM_CM(noEchoRange);
+				detector->noEchoes++;
+			}
+			else if (range < 0)
+			{
+				range = detector->lastValid;
+				detector->timeouts++;
+			}
+			
+			detector->lastValid = range;
+			input[MEDIAN_WINDOW - 1 + i] = range;
+			times[MEDIAN_WINDOW - 1 + i] = samples[start + i].timestamp;
+		}
+		
+		medianFilter(input, median, count);
+		
+		//each median belongs to the reading in the middle of its window
+		for (int i = 0; i < count; i++)
+		{
+			long long time = times[i + MEDIAN_WINDOW/2];
+			
+			if (!detector->occupied && median[i] <= detector->enterThreshold)
+			{
+				detector->occupied = true;
+				detector->occupiedSince = time;
+				events[numEvents++] = (struct VehicleEvent){time, true, 0};
+			}
+			else if (detector->occupied && median[i] > detector->exitThreshold)
+			{
+				detector->occupied = false;
+				events[numEvents++] = (struct VehicleEvent){time, false, (time - detector->occupiedSince)/1e9};
+			}
+		}
+		
+		memcpy(detector->history, input + count, sizeof(detector->history));
+		memcpy(detector->historyTime, times + count, sizeof(detector->historyTime));
+	}
+	
+	return numEvents;
+}
+
+#ifndef TRAFFIC_NO_SIMD
+typedef sensorRange rangeVector __attribute__((vector_size(32)));	//eight lanes; GCC splits it where the target is narrower
+typedef int intVector __attribute__((vector_size(32)));
+
+//lane-wise min and max by masking; macros rather than functions so no vector crosses a call boundary
+#define vectorSelect(mask, a, b) ((rangeVector)(((mask) & (intVector)(a)) | (~(mask) & (intVector)(b))))
+#define vectorMin(a, b) ({ rangeVector x_ = (a), y_ = (b); vectorSelect(x_ < y_, x_, y_); })
+#define vectorMax(a, b) ({ rangeVector x_ = (a), y_ = (b); vectorSelect(x_ < y_, y_, x_); })
+#endif
+
+static inline sensorRange rangeMin (sensorRange a, sensorRange b)
+{
+	return a < b ? a : b;
+}
+
+static inline sensorRange rangeMax (sensorRange a, sensorRange b)
+{
+	return a < b ? b : a;
+}
+
+//median of 5 without sorting: drop the smallest and largest of the first four, then take the median
+//of the two left and the fifth
+static inline sensorRange scalarMedian5 (sensorRange a, sensorRange b, sensorRange c, sensorRange d, sensorRange e)
+{
+	sensorRange low = rangeMax(rangeMin(a, b), rangeMin(c, d));
+	sensorRange high = rangeMin(rangeMax(a, b), rangeMax(c, d));
+	
+	return rangeMax(rangeMin(low, high), rangeMin(rangeMax(low, high), e));
+}
+
+//output[i] is the median of input[i] to input[i + MEDIAN_WINDOW - 1]; eight windows at a time where vectors are available
+void medianFilter (const sensorRange input[], sensorRange output[], int numOutputs)
+{
+	int i = 0;
+	
+#ifndef TRAFFIC_NO_SIMD
+	for (; i + 8 <= numOutputs; i += 8)
+	{
+		rangeVector a, b, c, d, e;
+		
+		memcpy(&a, input + i, sizeof(a));
+		memcpy(&b, input + i + 1, sizeof(b));
+		memcpy(&c, input + i + 2, sizeof(c));
+		memcpy(&d, input + i + 3, sizeof(d));
+		memcpy(&e, input + i + 4, sizeof(e));
+		
+		rangeVector low = vectorMax(vectorMin(a, b), vectorMin(c, d));
+		rangeVector high = vectorMin(vectorMax(a, b), vectorMax(c, d));
+		rangeVector median = vectorMax(vectorMin(low, high), vectorMin(vectorMax(low, high), e));
+		
+		memcpy(output + i, &median, sizeof(median));
+	}
+#endif
+	
+	for (; i < numOutputs; i++)
+	{
+		output[i] = scalarMedian5(input[i], input[i + 1], input[i + 2], input[i + 3], input[i + 4]);
+	}
+}
+
+//true when no reading short of a new car can produce an event, so sampling may wait for the next one
+bool detectorSettled (struct Detector *detector)
+{
+	if (detector->occupied)
+	{
+		return false;
+	}
+	
+	for (int i = 0; i < MEDIAN_WINDOW - 1; i++)
+	{
+		if (detector->history[i] <= detector->enterThreshold)
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+intervalCPS calcCarsPerSecond (struct StatsOverInterval intervalStats)
+{
+#ifdef TRAFFIC_FIXED_POINT
+	if (intervalStats.timeInterval <= 0)
+	{
+		return 0;
+	}
+	
+	//cars per million seconds, rounded to nearest
+	int64_t cps = ((int64_t)intervalStats.numCars*1000000000LL + intervalStats.timeInterval/2)/intervalStats.timeInterval;
+	return cps;
+#else
+	float cps = intervalStats.numCars/intervalStats.timeInterval;
+	return cps;
+#endif
+}
+
+float calcTotalTime (struct StatsOverInterval statsInterval[ ], int sizeStats)
+{
+	intervalSum total = 0;
+	for (int i = 0; i < sizeStats; i++)
+	{
+		total += statsInterval[i].timeInterval;
+	}
+	return TIME_TO_SECONDS(total);
+}
+
+int calcTotalCars (struct StatsOverInterval statsInterval[ ], int sizeStats)
+{
+	int total = 0;
+	for (int i = 0; i < sizeStats; i++)
+	{
+		total += statsInterval[i].numCars;
+	}
+	return total;
+}
+
+int calcMaxCars (struct StatsOverInterval statsInterval[ ], int sizeStats)
+{
+	int max = statsInterval[0].numCars;
+	for (int i = 0; i < sizeStats ; i++)
+	{
+		if (statsInterval[i].numCars > max)
+		{
+			max = statsInterval[i].numCars;
+		}
+	}
+	return max;
+}
+
+int calcMinCars (struct StatsOverInterval statsInterval[ ], int sizeStats)
+{
+	int min = statsInterval[0].numCars;
+	for (int i = 0; i < sizeStats; i++)
+	{
+		if (statsInterval[i].numCars < min)
+		{
+			min = statsInterval[i].numCars;
+		}
+	}
+	return min;
+}
+
+float calcAvgCars (struct StatsOverInterval statsInterval[ ], int sizeStats)
+{
+	float total = 0;
+	for (int i = 0; i < sizeStats; i++)
+	{
+		total += statsInterval[i].numCars;
+	}
+	return total/sizeStats;
+}
+
+float calcAvgTime (struct StatsOverInterval statsInterval[ ], int sizeStats)
+{
+	intervalSum total = 0;
+	for (int i = 0; i < sizeStats; i++)
+	{
+		total += statsInterval[i].timeInterval;
+	}
+	return TIME_TO_SECONDS(total)/sizeStats;
+}
+
+int calcModeCars (struct StatsOverInterval statsInterval[], int sizeStats, int modes[])
+{
+	int numModes = 0;
+	
+	int *newData = malloc(sizeStats*sizeof(int));
+	
+	for (int i = 0; i < sizeStats; i++)
+	{
+		newData[i] = statsInterval[i].numCars;
+	}
+	
+	sortInt (newData,sizeStats);
+	
+	int sizeMode = 0;
+	int indexMode = 0;
+	int maxCount = 1;
+	int modeCount = 1;
+	bool firstTime = true;
+	
+	for (int i = 0; i <= sizeStats-1; i++)
+	{
+		if (i+1 < sizeStats && newData[i] == newData[i+1])
+		{
+			modeCount++;
+			
+			if (modeCount == maxCount)
+			{
+				modes[indexMode] = newData[i];
+				indexMode++;
+				sizeMode++;
+			}
+			if (modeCount > maxCount)
+			{
+				maxCount = modeCount;
+				
+				if (firstTime)
+				{
+					indexMode = 0;
+					sizeMode = 0;
+					modes[indexMode] = newData[i];
+					sizeMode++;
+					indexMode++;
+					
+					firstTime = false;
+				}
+			}
+		}
+		else
+		{
+			if (maxCount == 1)
+			{
+				modes[indexMode] = newData[i];
+				indexMode++;
+				sizeMode++;
+				firstTime = true;
+			}
+			else
+			{
+				modeCount = 1;
+				firstTime = true;
+			}
+		}
+			
+	}
+	
+	numModes = sizeMode;
+	free(newData);
+
+	return numModes;	
+}
+
+bool sortInt(int dataset[], const int size)
+{
+	qsort(dataset, size, sizeof(int), compareInt);
+	return true;
+}
+
+int compareInt(const void *a, const void *b)
+{
+	int x = *(const int *)a;
+	int y = *(const int *)b;
+	
+	return (x > y) - (x < y);
+}
+
+bool sortFloat(float dataset[], const int size)
+{
+	qsort(dataset, size, sizeof(float), compareFloat);
+	return true;
+}
+
+int compareFloat(const void *a, const void *b)
+{
+	float x = *(const float *)a;
+	float y = *(const float *)b;
+	
+	return (x > y) - (x < y);
+}
+
+int compareCPS(const void *a, const void *b)
+{
+	intervalCPS x = *(const intervalCPS *)a;
+	intervalCPS y = *(const intervalCPS *)b;
+	
+	return (x > y) - (x < y);
+}
+
+//largest r with r*r <= value, one result bit per step
+uint32_t integerSqrt(uint64_t value)
+{
+	uint64_t root = 0;
+	uint64_t bit = 1ULL << 62;
+	
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+	
+	while (bit != 0)
+	{
+		if (value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		
+		bit >>= 2;
+	}
+	
+	return root;
+}
+
+//reorders values so values[k] is the one a sort would put there, with nothing larger before it or smaller after it
+void selectCPS(intervalCPS values[], int size, int k)
+{
+	int left = 0;
+	int right = size - 1;
+	
+	while (left < right)
+	{
+		intervalCPS pivot = values[k];
+		int i = left;
+		int j = right;
+		
+		while (i <= j)
+		{
+			while (values[i] < pivot)
+			{
+				i++;
+			}
+			while (pivot < values[j])
+			{
+				j--;
+			}
+			
+			if (i <= j)
+			{
+				intervalCPS swap = values[i];
+				values[i++] = values[j];
+				values[j--] = swap;
+			}
+		}
+		
+		if (j < k)
+		{
+			left = i;
+		}
+		if (k < i)
+		{
+			right = j;
+		}
+	}
+}
+
+float calcMaxCPS (struct StatsOverInterval statsInterval[ ], int sizeStats)
+{
+	intervalCPS max = statsInterval[0].cps;
+	for (int i = 0; i < sizeStats ; i++)
+	{
+		if (statsInterval[i].cps > max)
+		{
+			max = statsInterval[i].cps;
+		}
+	}
+	return CPS_TO_FLOAT(max);
+}
+
+float calcMinCPS (struct StatsOverInterval statsInterval[ ], int sizeStats)
+{
+	intervalCPS min = statsInterval[0].cps;
+	for (int i = 0; i < sizeStats; i++)
+	{
+		if (statsInterval[i].cps < min)
+		{
+			min = statsInterval[i].cps;
+		}
+	}
+	return CPS_TO_FLOAT(min);
+}
+
+float calcAverageCPS (struct StatsOverInterval statsInterval[ ], int sizeStats)
+{
+	intervalSum total = 0;
+	for (int i = 0; i < sizeStats; i++)
+	{
+		total += statsInterval[i].cps;
+	}
+	return CPS_TO_FLOAT(total)/sizeStats;
+}
+
+float calcMedianCPS (struct StatsOverInterval statsInterval[ ], int sizeStats)
+{
+	float median;
+	
+	int j = 0;
+	intervalCPS *set = malloc(sizeStats*sizeof(intervalCPS));
+
+	while (j < sizeStats)
+	{
+		set[j] = statsInterval[j].cps;
+		j++;
+	}
+	
+	qsort(set, sizeStats, sizeof(intervalCPS), compareCPS);
+	
+	if (sizeStats % 2 == 0)
+	{
+		median = CPS_TO_FLOAT(set[sizeStats/2] + set[(sizeStats/2)-1])/2;
+	}
+	else
+	{
+		median = CPS_TO_FLOAT(set[(sizeStats-1)/2]);
+	}
+	
+	free(set);
+	
+	return median;
+}
+
+float calcPopStdDevCPS(struct StatsOverInterval statsInterval[], int sizeStats) 
+{
+	if (sizeStats <= 0)
+	{
+		return -1;
+	}
+	
+#ifdef TRAFFIC_FIXED_POINT
+	int64_t total = 0;
+	uint64_t popdev = 0;
+	
+	for (int j = 0; j < sizeStats; j++)
+	{
+		total += statsInterval[j].cps;
+	}
+	
+	int64_t average = total/sizeStats;
+	
+	for (int j = 0; j < sizeStats; j++)
+	{
+		int64_t difference = statsInterval[j].cps - average;
+		popdev += difference*difference;
+	}
+	
+	return CPS_TO_FLOAT((float)integerSqrt(popdev/sizeStats));
+#else
+	float average = calcAverageCPS(statsInterval, sizeStats);	//computed once, not per element
+	int j = 0;
+	float popdev = 0;
+	while (j < sizeStats)
+	{
+		popdev += (statsInterval[j].cps-average)*(statsInterval[j].cps-average);
+		j++;
+	}
+	popdev = sqrt(popdev/sizeStats);
+	
+	return popdev;
+#endif
+}
+
+float calcSmplStdDevCPS(struct StatsOverInterval statsInterval[ ], int sizeStats) 
+{
+	if (sizeStats <= 1)
+	{
+		return -1;
+	}
+	
+#ifdef TRAFFIC_FIXED_POINT
+	int64_t total = 0;
+	uint64_t smpldev = 0;
+	
+	for (int j = 0; j < sizeStats; j++)
+	{
+		total += statsInterval[j].cps;
+	}
+	
+	int64_t average = total/sizeStats;
+	
+	for (int j = 0; j < sizeStats; j++)
+	{
+		int64_t difference = statsInterval[j].cps - average;
+		smpldev += difference*difference;
+	}
+	
+	return CPS_TO_FLOAT((float)integerSqrt(smpldev/(sizeStats-1)));
+#else
+	float average = calcAverageCPS(statsInterval, sizeStats);	//computed once, not per element
+	int j = 0;
+	float smpldev = 0;
+	while (j < sizeStats)
+	{
+		smpldev += (statsInterval[j].cps-average)*(statsInterval[j].cps-average);
+		j++;
+	}
+	smpldev = sqrt(smpldev/(sizeStats-1));
+	
+	return smpldev;
+#endif
+}
+
+float calcTimeSaved (struct StatsOverInterval statsInterval[ ], int sizeStats, const float defaultIntersectionTime)
+{
+	intervalSum total = 0;
+	for (int i = 0; i < sizeStats; i++)
+	{
+		total += statsInterval[i].timeInterval;
+	}
+	return TIME_TO_SECONDS(sizeStats*(intervalSum)TIME_FROM_SECONDS(defaultIntersectionTime) - total);
+}
+
+struct StatsOverSimulation computeStatsOverSimulation(struct StatsOverInterval intervalStats[], int sizeStats)
+{
+	char funcTag[] = "StatsOverSimulation";
+	writeToLog(date, logDegree, 9, funcTag, 0);
+	
+	struct StatsAccumulator acc;
+	initAccumulator(&acc);
+	
+	for (int i = 0; i < sizeStats; i++)
+	{
+		accumulateInterval(&acc, intervalStats[i]);
+	}
+	
+	struct StatsOverSimulation statsSim = snapshotAccumulator(&acc, baselineGreenTime);
+	freeAccumulator(&acc);
+	
+	writeToLog(date, logDegree, 10, funcTag, 0);
+	return statsSim;
+	
+}
+
+void initAccumulator(struct StatsAccumulator *acc)
+{
+	memset(acc, 0, sizeof(struct StatsAccumulator));
+}
+
+void accumulateInterval(struct StatsAccumulator *acc, struct StatsOverInterval interval)
+{
+	acc->count++;
+	acc->totalCars += interval.numCars;
+	acc->totalTime += interval.timeInterval;
+	
+	if (acc->count == 1 || interval.numCars > acc->maxCars)
+	{
+		acc->maxCars = interval.numCars;
+	}
+	if (acc->count == 1 || interval.numCars < acc->minCars)
+	{
+		acc->minCars = interval.numCars;
+	}
+	if (acc->count == 1 || interval.cps > acc->maxCPS)
+	{
+		acc->maxCPS = interval.cps;
+	}
+	if (acc->count == 1 || interval.cps < acc->minCPS)
+	{
+		acc->minCPS = interval.cps;
+	}
+	
+#ifdef TRAFFIC_FIXED_POINT
+	//plain sums are exact in integers, so the variance needs no running mean
+	acc->sumCPS += interval.cps;
+	acc->sumSquaresCPS += (int64_t)interval.cps*interval.cps;
+#else
+	//Welford update of the mean and squared differences
+	double delta = interval.cps - acc->meanCPS;
+	acc->meanCPS += delta/acc->count;
+	acc->sumSquaresCPS += delta*(interval.cps - acc->meanCPS);
+#endif
+	
+	//median: keep the two halves balanced so the middle is always at the heap tops
+	if (acc->sizeLower >= acc->capacityCPS || acc->sizeUpper >= acc->capacityCPS)
+	{
+		acc->capacityCPS = acc->capacityCPS == 0 ? 64 : acc->capacityCPS*2;
+		acc->lowerCPS = realloc(acc->lowerCPS, acc->capacityCPS*sizeof(intervalCPS));
+		acc->upperCPS = realloc(acc->upperCPS, acc->capacityCPS*sizeof(intervalCPS));
+	}
+	
+	if (acc->sizeLower == 0 || interval.cps <= acc->lowerCPS[0])
+	{
+		heapPush(acc->lowerCPS, acc->sizeLower++, interval.cps, true);
+	}
+	else
+	{
+		heapPush(acc->upperCPS, acc->sizeUpper++, interval.cps, false);
+	}
+	
+	if (acc->sizeLower > acc->sizeUpper + 1)
+	{
+		heapPush(acc->upperCPS, acc->sizeUpper++, heapPop(acc->lowerCPS, acc->sizeLower--, true), false);
+	}
+	else if (acc->sizeUpper > acc->sizeLower)
+	{
+		heapPush(acc->lowerCPS, acc->sizeLower++, heapPop(acc->upperCPS, acc->sizeUpper--, false), true);
+	}
+	
+	//mode: count how often each number of cars has been seen
+	int cars = interval.numCars < 0 ? 0 : interval.numCars;
+	
+	if (cars >= acc->sizeCarCounts)
+	{
+		int newSize = acc->sizeCarCounts == 0 ? 64 : acc->sizeCarCounts;
+		while (newSize <= cars)
+		{
+			newSize *= 2;
+		}
+		
+		acc->carCounts = realloc(acc->carCounts, newSize*sizeof(int));
+		memset(acc->carCounts + acc->sizeCarCounts, 0, (newSize - acc->sizeCarCounts)*sizeof(int));
+		acc->sizeCarCounts = newSize;
+	}
+	
+	int frequency = ++acc->carCounts[cars];
+	
+	if (frequency > acc->maxFrequency)
+	{
+		acc->maxFrequency = frequency;
+		acc->numModes = 1;
+	}
+	else if (frequency == acc->maxFrequency)
+	{
+		acc->numModes++;
+	}
+}
+
+struct StatsOverSimulation snapshotAccumulator(struct StatsAccumulator *acc, const float defaultIntersectionTime)
+{
+	struct StatsOverSimulation statsSim;
+	memset(&statsSim, 0, sizeof(statsSim));
+	
+	statsSim.totalCars = acc->totalCars;
+	statsSim.totalTime = TIME_TO_SECONDS(acc->totalTime);
+	statsSim.maxCars = acc->maxCars;
+	statsSim.minCars = acc->minCars;
+	statsSim.maxCPS = CPS_TO_FLOAT(acc->maxCPS);
+	statsSim.minCPS = CPS_TO_FLOAT(acc->minCPS);
+	statsSim.popStdDevCPS = -1;
+	statsSim.smplStdDevCPS = -1;
+	
+#ifdef TRAFFIC_FIXED_POINT
+	if (acc->count > 0)
+	{
+		//sum of squared differences from the mean truncated to a whole unit, which is off by under one unit
+		int64_t mean = acc->sumCPS/acc->count;
+		uint64_t sumSquares = acc->sumSquaresCPS - mean*(2*acc->sumCPS - acc->count*mean);
+		
+		statsSim.averageCars = (float)acc->totalCars/acc->count;
+		statsSim.averageTime = TIME_TO_SECONDS((float)acc->totalTime)/acc->count;
+		statsSim.avgCPS = CPS_TO_FLOAT((float)acc->sumCPS)/acc->count;
+		statsSim.popStdDevCPS = CPS_TO_FLOAT((float)integerSqrt(sumSquares/acc->count));
+		statsSim.timeSaved = TIME_TO_SECONDS((float)(acc->count*(int64_t)TIME_FROM_SECONDS(defaultIntersectionTime) - acc->totalTime));
+		
+		if (acc->count > 1)
+		{
+			statsSim.smplStdDevCPS = CPS_TO_FLOAT((float)integerSqrt(sumSquares/(acc->count-1)));
+		}
+	}
+#else
+	if (acc->count > 0)
+	{
+		statsSim.averageCars = (float)acc->totalCars/acc->count;
+		statsSim.averageTime = acc->totalTime/acc->count;
+		statsSim.avgCPS = acc->meanCPS;
+		statsSim.popStdDevCPS = sqrt(acc->sumSquaresCPS/acc->count);
+		statsSim.timeSaved = acc->count*defaultIntersectionTime - acc->totalTime;
+	}
+	
+	if (acc->count > 1)
+	{
+		statsSim.smplStdDevCPS = sqrt(acc->sumSquaresCPS/(acc->count-1));
+	}
+#endif
+	
+	if (acc->count > 0)
+	{
+		if (acc->sizeLower > acc->sizeUpper)
+		{
+			statsSim.medianCPS = CPS_TO_FLOAT(acc->lowerCPS[0]);
+		}
+		else
+		{
+			statsSim.medianCPS = CPS_TO_FLOAT(acc->lowerCPS[0] + acc->upperCPS[0])/2;
+		}
+	}
+	
+	//every car count seen maxFrequency times is a mode, smallest first
+	statsSim.modeCars = malloc((acc->numModes > 0 ? acc->numModes : 1)*sizeof(int));
+	
+	for (int cars = 0; cars < acc->sizeCarCounts && statsSim.numModes < acc->numModes; cars++)
+	{
+		if (acc->maxFrequency > 0 && acc->carCounts[cars] == acc->maxFrequency)
+		{
+			statsSim.modeCars[statsSim.numModes] = cars;
+			statsSim.numModes++;
+		}
+	}
+	
+	return statsSim;
+}
+
+void freeAccumulator(struct StatsAccumulator *acc)
+{
+	free(acc->lowerCPS);
+	free(acc->upperCPS);
+	free(acc->carCounts);
+	initAccumulator(acc);
+}
+
+//adds everything other has seen to acc, leaving it as if acc had been given both sets of intervals
+void mergeAccumulator(struct StatsAccumulator *acc, struct StatsAccumulator *other)
+{
+	if (other->count == 0)
+	{
+		return;
+	}
+	
+	if (acc->count == 0 || other->maxCars > acc->maxCars)
+	{
+		acc->maxCars = other->maxCars;
+	}
+	if (acc->count == 0 || other->minCars < acc->minCars)
+	{
+		acc->minCars = other->minCars;
+	}
+	if (acc->count == 0 || other->maxCPS > acc->maxCPS)
+	{
+		acc->maxCPS = other->maxCPS;
+	}
+	if (acc->count == 0 || other->minCPS < acc->minCPS)
+	{
+		acc->minCPS = other->minCPS;
+	}
+	
+	int count = acc->count + other->count;
+	
+#ifdef TRAFFIC_FIXED_POINT
+	acc->sumCPS += other->sumCPS;
+	acc->sumSquaresCPS += other->sumSquaresCPS;
+#else
+	//Chan's combination of two Welford means and sums of squared differences
+	double delta = other->meanCPS - acc->meanCPS;
+	acc->sumSquaresCPS += other->sumSquaresCPS + delta*delta*acc->count*other->count/count;
+	acc->meanCPS += delta*other->count/count;
+#endif
+	
+	acc->count = count;
+	acc->totalCars += other->totalCars;
+	acc->totalTime += other->totalTime;
+	
+	//median: split the values of both at the middle again and rebuild the two heaps, linear in the count
+	intervalCPS *values = malloc(count*sizeof(intervalCPS));
+	int size = 0;
+	
+	for (int i = 0; i < acc->sizeLower; i++)
+	{
+		values[size++] = acc->lowerCPS[i];
+	}
+	for (int i = 0; i < acc->sizeUpper; i++)
+	{
+		values[size++] = acc->upperCPS[i];
+	}
+	for (int i = 0; i < other->sizeLower; i++)
+	{
+		values[size++] = other->lowerCPS[i];
+	}
+	for (int i = 0; i < other->sizeUpper; i++)
+	{
+		values[size++] = other->upperCPS[i];
+	}
+	
+	int lower = (size + 1)/2;
+	selectCPS(values, size, lower - 1);
+	
+	acc->capacityCPS = lower;
+	acc->lowerCPS = realloc(acc->lowerCPS, acc->capacityCPS*sizeof(intervalCPS));
+	acc->upperCPS = realloc(acc->upperCPS, acc->capacityCPS*sizeof(intervalCPS));
+	acc->sizeLower = 0;
+	acc->sizeUpper = 0;
+	
+	for (int i = 0; i < lower; i++)
+	{
+		heapPush(acc->lowerCPS, acc->sizeLower++, values[i], true);
+	}
+	for (int i = lower; i < size; i++)
+	{
+		heapPush(acc->upperCPS, acc->sizeUpper++, values[i], false);
+	}
+	
+	free(values);
+	
+	//mode: add the histograms and find the most frequent car counts again
+	if (other->sizeCarCounts > acc->sizeCarCounts)
+	{
+		acc->carCounts = realloc(acc->carCounts, other->sizeCarCounts*sizeof(int));
+		memset(acc->carCounts + acc->sizeCarCounts, 0, (other->sizeCarCounts - acc->sizeCarCounts)*sizeof(int));
+		acc->sizeCarCounts = other->sizeCarCounts;
+	}
+	
+	acc->maxFrequency = 0;
+	acc->numModes = 0;
+	
+	for (int cars = 0; cars < acc->sizeCarCounts; cars++)
+	{
+		if (cars < other->sizeCarCounts)
+		{
+			acc->carCounts[cars] += other->carCounts[cars];
+		}
+		
+		if (acc->carCounts[cars] > acc->maxFrequency)
+		{
+			acc->maxFrequency = acc->carCounts[cars];
+			acc->numModes = 1;
+		}
+		else if (acc->carCounts[cars] == acc->maxFrequency && acc->maxFrequency > 0)
+		{
+			acc->numModes++;
+		}
+	}
+}
+
+void freeStatsOverSimulation(struct StatsOverSimulation *statsSim)
+{
+	free(statsSim->modeCars);
+	statsSim->modeCars = NULL;
+	statsSim->numModes = 0;
+}
+
+bool initIntervalStore(struct IntervalStore *store, int maxSize, char spillFilename[])
+{
+	memset(store, 0, sizeof(struct IntervalStore));
+	store->maxSize = maxSize;
+	store->spillFd = -1;
+	
+	if (spillFilename != NULL)
+	{
+		store->spillFd = open(spillFilename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		
+		if (store->spillFd < 0)
+		{
+			return false;
+		}
+		
+		unlink(spillFilename);	//scratch space only; gone once the store is closed
+	}
+	
+	return true;
+}
+
+int intervalsPerChunk()
+{
+	return intervalChunkBytes/sizeof(struct StatsOverInterval);
+}
+
+bool intervalStorePush(struct IntervalStore *store, struct StatsOverInterval interval)
+{
+	if (store->maxSize > 0 && store->size >= store->maxSize)
+	{
+		store->dropped++;
+		return false;
+	}
+	
+	int perChunk = intervalsPerChunk();
+	
+	//last chunk is full (or there is none yet): add another
+	if (store->size == store->numChunks*perChunk)
+	{
+		if (store->numChunks == store->capacityChunks)
+		{
+			store->capacityChunks = store->capacityChunks == 0 ? 16 : store->capacityChunks*2;
+			store->chunks = realloc(store->chunks, store->capacityChunks*sizeof(struct StatsOverInterval *));
+		}
+		
+		struct StatsOverInterval *chunk;
+		
+		if (store->spillFd >= 0)
+		{
+			//grow the backing file and map the new chunk from it so the page cache holds the data
+			off_t offset = (off_t)store->numChunks*intervalChunkBytes;
+			
+			if (ftruncate(store->spillFd, offset + intervalChunkBytes) != 0)
+			{
+				store->dropped++;
+				return false;
+			}
+			
+			chunk = mmap(NULL, intervalChunkBytes, PROT_READ | PROT_WRITE, MAP_SHARED, store->spillFd, offset);
+			
+			if (chunk == MAP_FAILED)
+			{
+				store->dropped++;
+				return false;
+			}
+		}
+		else
+		{
+			chunk = malloc(intervalChunkBytes);
+			
+			if (chunk == NULL)
+			{
+				store->dropped++;
+				return false;
+			}
+		}
+		
+		store->chunks[store->numChunks] = chunk;
+		store->numChunks++;
+	}
+	
+	store->chunks[store->size/perChunk][store->size%perChunk] = interval;
+	store->size++;
+	
+	return true;
+}
+
+struct StatsOverInterval *intervalStoreGet(struct IntervalStore *store, int index)
+{
+	int perChunk = intervalsPerChunk();
+	
+	return &store->chunks[index/perChunk][index%perChunk];
+}
+
+//drop every interval but keep the cap and spill file, ready to be filled again
+void clearIntervalStore(struct IntervalStore *store)
+{
+	for (int i = 0; i < store->numChunks; i++)
+	{
+		if (store->spillFd >= 0)
+		{
+			munmap(store->chunks[i], intervalChunkBytes);
+		}
+		else
+		{
+			free(store->chunks[i]);
+		}
+	}
+	
+	if (store->spillFd >= 0 && ftruncate(store->spillFd, 0) != 0)
+	{
+		close(store->spillFd);	//can't be reused; carry on in memory
+		store->spillFd = -1;
+	}
+	
+	free(store->chunks);
+	store->chunks = NULL;
+	store->numChunks = 0;
+	store->capacityChunks = 0;
+	store->size = 0;
+	store->dropped = 0;
+}
+
+void freeIntervalStore(struct IntervalStore *store)
+{
+	clearIntervalStore(store);
+	
+	if (store->spillFd >= 0)
+	{
+		close(store->spillFd);
+		store->spillFd = -1;
+	}
+}
+
+int envInt(const char *name, int fallback)
+{
+	char *value = getenv(name);
+	
+	if (value == NULL || value[0] == 0)
+	{
+		return fallback;
+	}
+	
+	return atoi(value);
+}
+
+//Open the journal at path. If it holds an unfinished run of the same approaches, that run's intervals
+//are read back and appending carries on after them; otherwise it starts out empty.
+struct Journal *openJournal(const char *path, struct PhaseTable *table, int syncEvery)
+{
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	
+	if (fd < 0)
+	{
+		return NULL;
+	}
+	
+	struct stat info;
+	
+	if (fstat(fd, &info) != 0 || (info.st_size < journalPageBytes && ftruncate(fd, journalPageBytes) != 0))
+	{
+		close(fd);
+		return NULL;
+	}
+	
+	struct JournalHeader *header = mmap(NULL, journalPageBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	
+	if (header == MAP_FAILED)
+	{
+		close(fd);
+		return NULL;
+	}
+	
+	struct Journal *journal = calloc(1, sizeof(struct Journal));
+	journal->fd = fd;
+	journal->header = header;
+	journal->syncEvery = syncEvery;
+	journal->path = path;
+	
+	if (!recoverJournal(journal, table))
+	{
+		//nothing to carry on from: start a new journal
+		if (ftruncate(fd, journalPageBytes) != 0)
+		{
+			closeJournal(journal, false);
+			return NULL;
+		}
+		
+		memset(header, 0, journalPageBytes);
+		memcpy(header->magic, "TRAFJRN", 8);
+		header->version = 1;
+		header->numApproaches = table->numApproaches;
+		
+		for (int i = 0; i < table->numApproaches; i++)
+		{
+			strcpy(header->names[i], table->approaches[i].name);
+		}
+		
+		msync(header, journalPageBytes, MS_SYNC);
+		journal->sequence = 0;
+	}
+	
+	//carry on in the chunk holding the next record
+	off_t next = journalPageBytes + (off_t)journal->sequence*sizeof(struct JournalRecord);
+	off_t offset = journalPageBytes + (next - journalPageBytes)/journalChunkBytes*journalChunkBytes;
+	
+	if (!journalMapChunk(journal, offset))
+	{
+		closeJournal(journal, false);
+		return NULL;
+	}
+	
+	journal->used = (next - offset)/sizeof(struct JournalRecord);
+	journal->synced = journal->used;
+	
+	return journal;
+}
+
+//Read an unfinished run back into the approaches' stores and statistics, up to the first record that
+//is torn or out of sequence. Whatever follows it is cut off so it can't be taken for later records.
+bool recoverJournal(struct Journal *journal, struct PhaseTable *table)
+{
+	struct JournalHeader *header = journal->header;
+	int map[MAX_APPROACHES];
+	
+	if (memcmp(header->magic, "TRAFJRN", 8) != 0 || header->version != 1 || header->clean || header->numApproaches > MAX_APPROACHES)
+	{
+		return false;
+	}
+	
+	//the table may have changed since; records of approaches it no longer has are skipped
+	for (uint32_t i = 0; i < header->numApproaches; i++)
+	{
+		map[i] = findApproach(table, header->names[i]);
+	}
+	
+	struct stat info;
+	
+	if (fstat(journal->fd, &info) != 0)
+	{
+		return false;
+	}
+	
+	uint32_t count = 0;
+	
+	for (off_t offset = journalPageBytes; offset < info.st_size; offset += journalChunkBytes)
+	{
+		size_t length = info.st_size - offset < journalChunkBytes ? info.st_size - offset : journalChunkBytes;
+		struct JournalRecord *records = mmap(NULL, length, PROT_READ, MAP_SHARED, journal->fd, offset);
+		
+		if (records == MAP_FAILED)
+		{
+			break;
+		}
+		
+		size_t numRecords = length/sizeof(struct JournalRecord);
+		size_t i = 0;
+		
+		for (; i < numRecords; i++)
+		{
+			struct JournalRecord record = records[i];
+			
+			if (record.sequence != count || record.checksum != journalChecksum(record) || record.approach >= header->numApproaches)
+			{
+				break;
+			}
+			
+			if (map[record.approach] >= 0)
+			{
+				struct Approach *approach = &table->approaches[map[record.approach]];
+				struct StatsOverInterval interval = {record.numCars, TIME_FROM_SECONDS(record.timeInterval), 0, record.startTime};
+				
+				interval.cps = calcCarsPerSecond(interval);
+				
+				intervalStorePush(&approach->intervals, interval);
+				accumulateInterval(&approach->stats, interval);
+			}
+			
+			count++;
+		}
+		
+		munmap(records, length);
+		
+		if (i < numRecords)
+		{
+			break;
+		}
+	}
+	
+	if (ftruncate(journal->fd, journalPageBytes + (off_t)count*sizeof(struct JournalRecord)) != 0)
+	{
+		return false;
+	}
+	
+	journal->sequence = count;
+	journal->recovered = count;
+	
+	return true;
+}
+
+//map the chunk at offset, growing the file to cover it
+bool journalMapChunk(struct Journal *journal, off_t offset)
+{
+	struct stat info;
+	
+	if (fstat(journal->fd, &info) != 0 || (info.st_size < offset + journalChunkBytes && ftruncate(journal->fd, offset + journalChunkBytes) != 0))
+	{
+		return false;
+	}
+	
+	struct JournalRecord *chunk = mmap(NULL, journalChunkBytes, PROT_READ | PROT_WRITE, MAP_SHARED, journal->fd, offset);
+	
+	if (chunk == MAP_FAILED)
+	{
+		return false;
+	}
+	
+	journal->chunk = chunk;
+	journal->chunkOffset = offset;
+	journal->used = 0;
+	journal->synced = 0;
+	
+	return true;
+}
+
+//append one interval; it is durable once the group it belongs to has been synced
+bool journalAppend(struct Journal *journal, int approach, struct StatsOverInterval interval)
+{
+	if (journal->chunk == NULL)
+	{
+		return false;
+	}
+	
+	if (journal->used == journalChunkBytes/(int)sizeof(struct JournalRecord))
+	{
+		journalSync(journal);
+		munmap(journal->chunk, journalChunkBytes);
+		
+		if (!journalMapChunk(journal, journal->chunkOffset + journalChunkBytes))
+		{
+			journal->chunk = NULL;
+			return false;
+		}
+	}
+	
+	struct JournalRecord record = {journal->sequence, 0, approach, interval.numCars, TIME_TO_SECONDS(interval.timeInterval), CPS_TO_FLOAT(interval.cps), interval.startTime};
+	record.checksum = journalChecksum(record);
+	
+	journal->chunk[journal->used] = record;
+	journal->used++;
+	journal->sequence++;
+	
+	if (journal->syncEvery > 0 && journal->used - journal->synced >= journal->syncEvery)
+	{
+		journalSync(journal);
+	}
+	
+	return true;
+}
+
+//group commit: flush the pages holding records appended since the last sync
+void journalSync(struct Journal *journal)
+{
+	if (journal->chunk == NULL || journal->synced == journal->used)
+	{
+		return;
+	}
+	
+	LATENCY_START(start);
+	
+	long pageSize = sysconf(_SC_PAGESIZE);
+	size_t from = journal->synced*sizeof(struct JournalRecord)/pageSize*pageSize;
+	size_t to = journal->used*sizeof(struct JournalRecord);
+	
+	msync((char *)journal->chunk + from, to - from, MS_SYNC);
+	journal->synced = journal->used;
+	
+	LATENCY_RECORD(LATENCY_JOURNAL_SYNC, start);
+}
+
+//clean marks a run that finished and wrote its stats, so the next start begins a new journal
+void closeJournal(struct Journal *journal, bool clean)
+{
+	if (journal == NULL)
+	{
+		return;
+	}
+	
+	journalSync(journal);
+	
+	if (journal->chunk != NULL)
+	{
+		munmap(journal->chunk, journalChunkBytes);
+	}
+	
+	if (clean)
+	{
+		journal->header->clean = 1;
+		msync(journal->header, journalPageBytes, MS_SYNC);
+	}
+	
+	munmap(journal->header, journalPageBytes);
+	close(journal->fd);
+	free(journal);
+}
+
+uint32_t journalChecksum(struct JournalRecord record)
+{
+	const unsigned char *bytes = (const unsigned char *)&record;
+	uint32_t hash = 2166136261u;
+	
+	record.checksum = 0;
+	
+	for (size_t i = 0; i < sizeof(record); i++)
+	{
+		hash = (hash ^ bytes[i])*16777619u;
+	}
+	
+	return hash;
+}
+
+void heapPush(intervalCPS heap[], int size, intervalCPS value, bool maxHeap)
+{
+	int i = size;
+	
+	//sift the new value up past smaller (max-heap) or larger (min-heap) parents
+	while (i > 0)
+	{
+		int parent = (i-1)/2;
+		
+		if (maxHeap ? heap[parent] >= value : heap[parent] <= value)
+		{
+			break;
+		}
+		
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	
+	heap[i] = value;
+}
+
+intervalCPS heapPop(intervalCPS heap[], int size, bool maxHeap)
+{
+	intervalCPS top = heap[0];
+	intervalCPS last = heap[size-1];
+	int i = 0;
+	
+	size--;
+	
+	//sift the last value down from the root
+	while (2*i+1 < size)
+	{
+		int child = 2*i+1;
+		
+		if (child+1 < size && (maxHeap ? heap[child+1] > heap[child] : heap[child+1] < heap[child]))
+		{
+			child++;
+		}
+		
+		if (maxHeap ? last >= heap[child] : last <= heap[child])
+		{
+			break;
+		}
+		
+		heap[i] = heap[child];
+		i = child;
+	}
+	
+	heap[i] = last;
+	
+	return top;
+}
+
+//environment settings for what the reports contain and which files are written
+void readOutputOptions ()
+{
+	//TRAFFIC_RAW_FORMAT picks text (default), binary or both for the raw interval files
+	char *rawFormat = getenv("TRAFFIC_RAW_FORMAT");
+	
+	if (rawFormat != NULL)
+	{
+		rawTextOutput = strcmp(rawFormat, "binary") != 0;
+		rawBinaryOutput = strcmp(rawFormat, "binary") == 0 || strcmp(rawFormat, "both") == 0;
+	}
+	
+	//TRAFFIC_REPORT_FORMAT adds csv, json or both next to the text stats files
+	char *reportFormat = getenv("TRAFFIC_REPORT_FORMAT");
+	
+	if (reportFormat != NULL)
+	{
+		reportCsvOutput = strcmp(reportFormat, "csv") == 0 || strcmp(reportFormat, "both") == 0;
+		reportJsonOutput = strcmp(reportFormat, "json") == 0 || strcmp(reportFormat, "both") == 0;
+	}
+	
+	if (getenv("TRAFFIC_BASELINE_GREEN") != NULL)
+	{
+		baselineGreenTime = atof(getenv("TRAFFIC_BASELINE_GREEN"));
+	}
+}
+
+bool writeStatsToFile (char filename[], struct Approach approaches[], int numApproaches, struct StatsOverSimulation statsSim[])
+{
+	char funcTag[] = "writeStatsToFile";
+	writeToLog(date, logDegree, 9, funcTag, 0);
+	
+	//one buffer serves every file, so it is only grown for the largest
+	struct ReportBuffer report = {NULL, 0, 0, -1, true, ""};
+	bool ok = true;
+	
+	for (int a = 0; a < numApproaches; a++)
+	{
+		struct IntervalStore *statsInterval = &approaches[a].intervals;
+		struct StatsOverSimulation *stats = &statsSim[a];
+		char upperName[16];
+		int c;
+		
+		//file names use the upper case approach name, e.g. _NORTH_RAW.rawstat
+		for (c = 0; approaches[a].name[c] != 0 && c < 15; c++)
+		{
+			upperName[c] = toupper((unsigned char)approaches[a].name[c]);
+		}
+		upperName[c] = 0;
+		
+		//Raw Data
+		if (rawTextOutput)
+		{
+			char fullFilenameRaw[200];
+			snprintf(fullFilenameRaw, sizeof(fullFilenameRaw), "%s_%s_RAW.rawstat", filename, upperName);
+			
+			//about 100 bytes an interval
+			reportOpen(&report, fullFilenameRaw, 128 + (size_t)statsInterval->size*100);
+			reportPrintf(&report, "Raw Data for %s Direction\r\nx--------x--------x-------x--------x\r\n\r\n", approaches[a].name);
+			for (int i = 0; i < statsInterval->size; i++)
+			{
+				struct StatsOverInterval *interval = intervalStoreGet(statsInterval, i);
+				reportPrintf(&report, "Time Interval #%d: \r\nNumber of Cars: %d\r\nTime Interval Length: %f s\r\nCars Per Second: %f cps\r\n\r\n", i+1, interval->numCars, TIME_TO_SECONDS(interval->timeInterval), CPS_TO_FLOAT(interval->cps));
+			}
+			ok = reportClose(&report) && ok;
+		}
+		
+		if (rawBinaryOutput)
+		{
+			ok = writeRawBinaryFile(filename, statsInterval, approaches[a].name) && ok;
+		}
+		
+		//Simulation Stats
+		char fullFilenameStat[200];
+		snprintf(fullFilenameStat, sizeof(fullFilenameStat), "%s_%s_SIM.stat", filename, upperName);
+		
+		reportOpen(&report, fullFilenameStat, 1024 + stats->numModes*8);
+		reportPrintf(&report, "Simulation Statistics for %s Direction\r\nx--------x--------x-------x--------x\r\n\r\n", approaches[a].name);
+		for (int f = 0; f < numStatFields; f++)
+		{
+			reportPrintf(&report, "%s: ", statFields[f].label);
+			reportStatValue(&report, &statFields[f], stats, 't');
+			reportPrintf(&report, "%s\r\n", statFields[f].unit);
+		}
+		reportPrintf(&report, "Control Strategy: %s\r\n\r\n", controlStrategyName);
+		
+		reportPrintf(&report, "         _______\r\n       //  ||  \\\\\r\n _____//___||__\\ \\___\r\n )  _    HIIIII-5 _    \\\r\n |_/  \\_________ /  \\___|\r\n___ \\_/_________ \\_/______\r\n");
+		
+		ok = reportClose(&report) && ok;
+	}
+	
+	const char *names[numApproaches > 0 ? numApproaches : 1];
+	char fullFilename[200];
+	
+	for (int a = 0; a < numApproaches; a++)
+	{
+		names[a] = approaches[a].name;
+	}
+	
+	if (reportCsvOutput)
+	{
+		snprintf(fullFilename, sizeof(fullFilename), "%s_STATS.csv", filename);
+		ok = writeStatsCsv(&report, fullFilename, names, numApproaches, statsSim) && ok;
+	}
+	
+	if (reportJsonOutput)
+	{
+		snprintf(fullFilename, sizeof(fullFilename), "%s_STATS.json", filename);
+		ok = writeStatsJson(&report, fullFilename, names, numApproaches, statsSim) && ok;
+	}
+	
+	free(report.data);
+	
+	writeToLog(date, logDegree, 10, funcTag, 0);
+	return ok;
+	
+}
+
+//header row of the field keys, then a row per approach
+bool writeStatsCsv (struct ReportBuffer *report, const char *fullFilename, const char *names[], int numApproaches, struct StatsOverSimulation statsSim[])
+{
+	reportOpen(report, fullFilename, 256 + numApproaches*512);
+	reportPrintf(report, "approach,strategy");
+	for (int f = 0; f < numStatFields; f++)
+	{
+		reportPrintf(report, ",%s", statFields[f].key);
+	}
+	reportPrintf(report, "\r\n");
+	
+	for (int a = 0; a < numApproaches; a++)
+	{
+		reportPrintf(report, "%s,%s", names[a], controlStrategyName);
+		for (int f = 0; f < numStatFields; f++)
+		{
+			reportPrintf(report, ",");
+			reportStatValue(report, &statFields[f], &statsSim[a], 'c');
+		}
+		reportPrintf(report, "\r\n");
+	}
+	
+	return reportClose(report);
+}
+
+//{"strategy": ..., "approaches": [{"name": ..., <field key>: <value>, ...}, ...]}
+bool writeStatsJson (struct ReportBuffer *report, const char *fullFilename, const char *names[], int numApproaches, struct StatsOverSimulation statsSim[])
+{
+	reportOpen(report, fullFilename, 256 + numApproaches*768);
+	reportPrintf(report, "{\n\t\"strategy\": \"%s\",\n\t\"approaches\": [", controlStrategyName);
+	
+	for (int a = 0; a < numApproaches; a++)
+	{
+		reportPrintf(report, "%s\n\t\t{\"name\": \"%s\"", a > 0 ? "," : "", names[a]);
+		for (int f = 0; f < numStatFields; f++)
+		{
+			reportPrintf(report, ", \"%s\": ", statFields[f].key);
+			reportStatValue(report, &statFields[f], &statsSim[a], 'j');
+		}
+		reportPrintf(report, "}");
+	}
+	
+	reportPrintf(report, "\n\t]\n}\n");
+	
+	return reportClose(report);
+}
+
+//starts a report file; expectedBytes sizes the buffer up front so formatting rarely has to grow it
+bool reportOpen(struct ReportBuffer *report, const char *filename, size_t expectedBytes)
+{
+	if (expectedBytes > reportFlushBytes)
+	{
+		expectedBytes = reportFlushBytes;
+	}
+	
+	if (report->capacity < expectedBytes)
+	{
+		char *data = realloc(report->data, expectedBytes);
+		
+		if (data != NULL)
+		{
+			report->data = data;
+			report->capacity = expectedBytes;
+		}
+	}
+	
+	snprintf(report->filename, sizeof(report->filename), "%s", filename);
+	report->length = 0;
+	report->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	report->ok = report->fd >= 0;
+	
+	return report->ok;
+}
+
+void reportPrintf(struct ReportBuffer *report, const char *format, ...)
+{
+	va_list args;
+	
+	for (;;)
+	{
+		size_t space = report->capacity - report->length;
+		
+		va_start(args, format);
+		int bytes = vsnprintf(report->data != NULL ? report->data + report->length : NULL, space, format, args);
+		va_end(args);
+		
+		if (bytes < 0)
+		{
+			report->ok = false;
+			return;
+		}
+		
+		if ((size_t)bytes < space)
+		{
+			report->length += bytes;
+			break;
+		}
+		
+		//too long for what is left: grow to fit and format it again
+		size_t capacity = report->capacity*2 > report->length + bytes + 1 ? report->capacity*2 : report->length + bytes + 1;
+		char *data = realloc(report->data, capacity);
+		
+		if (data == NULL)
+		{
+			report->ok = false;
+			return;
+		}
+		
+		report->data = data;
+		report->capacity = capacity;
+	}
+	
+	if (report->length >= reportFlushBytes)
+	{
+		reportWrite(report);
+	}
+}
+
+//formats one field of stats: 't' for the text report, 'c' for CSV, 'j' for JSON
+void reportStatValue(struct ReportBuffer *report, const struct StatField *field, struct StatsOverSimulation *stats, char format)
+{
+	const char *value = (const char *)stats + field->offset;
+	
+	switch (field->type)
+	{
+		case STAT_INT:
+			reportPrintf(report, "%d", *(const int *)value);
+			break;
+		case STAT_FLOAT:
+		{
+			float number = *(const float *)value;
+			
+			//JSON has no NaN or infinity
+			if (format == 'j' && !isfinite(number))
+			{
+				reportPrintf(report, "null");
+			}
+			else
+			{
+				reportPrintf(report, "%f", number);
+			}
+			break;
+		}
+		case STAT_MODES:
+		{
+			const int *modes = *(int * const *)value;
+			
+			reportPrintf(report, "%s", format == 'j' ? "[" : "");
+			for (int i = 0; i < stats->numModes; i++)
+			{
+				//a space in CSV keeps the list in one column
+				if (format == 't')
+				{
+					reportPrintf(report, "%d, ", modes[i]);
+				}
+				else
+				{
+					reportPrintf(report, "%s%d", i == 0 ? "" : (format == 'j' ? ", " : " "), modes[i]);
+				}
+			}
+			reportPrintf(report, "%s", format == 'j' ? "]" : "");
+			break;
+		}
+	}
+}
+
+//writes out what is buffered, carrying on after short writes
+bool reportWrite(struct ReportBuffer *report)
+{
+	size_t written = 0;
+	
+	while (report->ok && written < report->length)
+	{
+		ssize_t bytes = write(report->fd, report->data + written, report->length - written);
+		
+		if (bytes < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		
+		if (bytes <= 0)
+		{
+			report->ok = false;
+			break;
+		}
+		
+		written += bytes;
+	}
+	
+	report->length = 0;
+	
+	return report->ok;
+}
+
+bool reportClose(struct ReportBuffer *report)
+{
+	if (report->fd < 0)
+	{
+		return false;
+	}
+	
+	bool ok = reportWrite(report);
+	ok = close(report->fd) == 0 && ok;
+	report->fd = -1;
+	
+	if (ok)
+	{
+		writeToLog(date, logDegree, 11, report->filename, 0);
+	}
+	
+	return ok;
+}
+
+//one file summing up how the control strategy did, so runs with different strategies can be compared
+bool writeStrategyReport (char filename[], struct Controller *ctrl, struct StatsOverSimulation statsSim[])
+{
+	struct ReportBuffer report = {NULL, 0, 0, -1, true, ""};
+	char fullFilename[200];
+	snprintf(fullFilename, sizeof(fullFilename), "%s_STRATEGY.stat", filename);
+	
+	if (!reportOpen(&report, fullFilename, 1024))
+	{
+		free(report.data);
+		return false;
+	}
+	
+	reportPrintf(&report, "Control Strategy: %s\r\nx--------x--------x-------x--------x\r\n\r\n", ctrl->strategy->name);
+	
+	for (int a = 0; a < ctrl->table->numApproaches; a++)
+	{
+		reportPrintf(&report, "%s Total Cars: %d\r\n", ctrl->table->approaches[a].name, statsSim[a].totalCars);
+		reportPrintf(&report, "%s Average Cars Per Second: %f cps\r\n", ctrl->table->approaches[a].name, statsSim[a].avgCPS);
+		reportPrintf(&report, "%s Time Saved: %f s\r\n", ctrl->table->approaches[a].name, statsSim[a].timeSaved);
+	}
+	
+	if (backend->report != NULL)
+	{
+		reportPrintf(&report, "\r\n");
+		backend->report(backend, &report);
+	}
+	
+	bool ok = reportClose(&report);
+	free(report.data);
+	
+	return ok;
+}
+
+//Sweep of timing plans: every combination of max green, gap-out and detection threshold from the grids
+//is run for the whole simulation time against the same synthetic traffic (one seed, so every plan sees the
+//same cars), then a second round tries the points halfway between the best plan and its grid
+//neighbours, skipping neighbours that did exactly as well since the point between them would too.
+//Candidates are independent, so workers simply take the next one until none are left.
+int runSweep (struct PhaseTable *table, const struct ControlStrategy *strategy, int simulationTime, unsigned int seed, int numWorkers)
+{
+	int numMaxGreens = sizeof(sweepMaxGreens)/sizeof(sweepMaxGreens[0]);
+	int numGapOuts = sizeof(sweepGapOuts)/sizeof(sweepGapOuts[0]);
+	int numThresholds = sizeof(sweepThresholds)/sizeof(sweepThresholds[0]);
+	int gridSize = numMaxGreens*numGapOuts*numThresholds;
+	struct Sweep sweep;
+	
+	if (numWorkers < 1)
+	{
+		numWorkers = 1;
+	}
+	
+	//room for the grid and the refinement round around its best point
+	sweep.candidates = calloc(gridSize + 26, sizeof(struct SweepCandidate));
+	sweep.table = table;
+	sweep.strategy = strategy;
+	sweep.simulationTime = simulationTime;
+	sweep.seed = seed;
+	
+	if (sweep.candidates == NULL)
+	{
+		return 1;
+	}
+	
+	for (int g = 0; g < numMaxGreens; g++)
+	{
+		for (int o = 0; o < numGapOuts; o++)
+		{
+			for (int t = 0; t < numThresholds; t++)
+			{
+				struct SweepCandidate *candidate = &sweep.candidates[(g*numGapOuts + o)*numThresholds + t];
+				
+				candidate->maxGreen = sweepMaxGreens[g];
+				candidate->gapOut = sweepGapOuts[o];
+				candidate->threshold = sweepThresholds[t];
+			}
+		}
+	}
+	
+	sweep.numCandidates = gridSize;
+	atomic_init(&sweep.next, 0);
+	runSweepBatch(&sweep, numWorkers);
+	
+	//the best plan's neighbours, found before sorting while the grid is still in order
+	struct SweepCandidate *best = &sweep.candidates[0];
+	int bestG = 0, bestO = 0, bestT = 0;
+	
+	for (int g = 0; g < numMaxGreens; g++)
+	{
+		for (int o = 0; o < numGapOuts; o++)
+		{
+			for (int t = 0; t < numThresholds; t++)
+			{
+				struct SweepCandidate *candidate = &sweep.candidates[(g*numGapOuts + o)*numThresholds + t];
+				
+				if (compareCandidates(candidate, best) < 0)
+				{
+					best = candidate;
+					bestG = g;
+					bestO = o;
+					bestT = t;
+				}
+			}
+		}
+	}
+	
+	int refined = 0;
+	
+	for (int g = bestG - 1; g <= bestG + 1; g++)
+	{
+		for (int o = bestO - 1; o <= bestO + 1; o++)
+		{
+			for (int t = bestT - 1; t <= bestT + 1; t++)
+			{
+				if (g < 0 || g >= numMaxGreens || o < 0 || o >= numGapOuts || t < 0 || t >= numThresholds || (g == bestG && o == bestO && t == bestT))
+				{
+					continue;
+				}
+				
+				struct SweepCandidate *neighbour = &sweep.candidates[(g*numGapOuts + o)*numThresholds + t];
+				
+				if (compareResults(neighbour, best) == 0)
+				{
+					continue;
+				}
+				
+				struct SweepCandidate *candidate = &sweep.candidates[gridSize + refined++];
+				
+				candidate->maxGreen = (best->maxGreen + neighbour->maxGreen)/2;
+				candidate->gapOut = (best->gapOut + neighbour->gapOut)/2;
+				candidate->threshold = (best->threshold + neighbour->threshold)/2;
+			}
+		}
+	}
+	
+	sweep.candidates += gridSize;
+	sweep.numCandidates = refined;
+	atomic_store(&sweep.next, 0);
+	runSweepBatch(&sweep, numWorkers);
+	sweep.candidates -= gridSize;
+	
+	qsort(sweep.candidates, gridSize + refined, sizeof(struct SweepCandidate), compareCandidates);
+	writeSweepReport(date, sweep.candidates, gridSize + refined);
+	
+	free(sweep.candidates);
+	
+	return 0;
+}
+
+void runSweepBatch (struct Sweep *sweep, int numWorkers)
+{
+	pthread_t threads[numWorkers];
+	int started = 0;
+	
+	for (int w = 1; w < numWorkers; w++)
+	{
+		if (pthread_create(&threads[started], NULL, sweepWorker, sweep) == 0)
+		{
+			started++;
+		}
+	}
+	
+	sweepWorker(sweep);	//this thread works too
+	
+	for (int w = 0; w < started; w++)
+	{
+		pthread_join(threads[w], NULL);
+	}
+}
+
+void *sweepWorker (void *arg)
+{
+	struct Sweep *sweep = arg;
+	int index;
+	
+	while ((index = atomic_fetch_add(&sweep->next, 1)) < sweep->numCandidates)
+	{
+		evaluateCandidate(sweep, &sweep->candidates[index]);
+	}
+	
+	return NULL;
+}
+
+//simulate the table with every phase timed by the candidate's plan
+void evaluateCandidate (struct Sweep *sweep, struct SweepCandidate *candidate)
+{
+	struct SimIntersection node;
+	struct Backend *previous = backend;
+	
+	memset(&node, 0, sizeof(node));
+	node.table = *sweep->table;
+	
+	for (int p = 0; p < node.table.numPhases; p++)
+	{
+		node.table.phases[p].maxGreen = candidate->maxGreen;
+		node.table.phases[p].gapOut = candidate->gapOut;
+		
+		if (node.table.phases[p].minGreen > candidate->maxGreen)
+		{
+			node.table.phases[p].minGreen = candidate->maxGreen;
+		}
+	}
+	
+	initSimIntersection(&node, sweep->strategy, sweep->seed, candidate->threshold, 0);
+	controllerRunUntil(&node.controller, secondsToNanos(sweep->simulationTime));
+	
+	candidate->timeSaved = 0;
+	candidate->avgCPS = 0;
+	candidate->varianceCPS = 0;
+	
+	for (int a = 0; a < node.table.numApproaches; a++)
+	{
+		struct StatsOverSimulation statsSim = snapshotAccumulator(&node.table.approaches[a].stats, baselineGreenTime);
+		
+		candidate->timeSaved += statsSim.timeSaved/sweep->simulationTime;
+		candidate->avgCPS += statsSim.avgCPS/node.table.numApproaches;
+		candidate->varianceCPS += statsSim.popStdDevCPS*statsSim.popStdDevCPS/node.table.numApproaches;
+		
+		freeStatsOverSimulation(&statsSim);
+	}
+	
+	candidate->averageDelay = simAverageDelay(node.backend);
+	
+	freeSimIntersection(&node);
+	backend = previous;
+}
+
+//how two candidates did, best first: lowest average delay (the simulation's ground truth), then most
+//time saved per simulated second, then highest average cps, then lowest cps variance; 0 when they did the same
+int compareResults (const struct SweepCandidate *first, const struct SweepCandidate *second)
+{
+	if (first->averageDelay != second->averageDelay)
+	{
+		return first->averageDelay > second->averageDelay ? 1 : -1;
+	}
+	
+	if (first->timeSaved != second->timeSaved)
+	{
+		return first->timeSaved < second->timeSaved ? 1 : -1;
+	}
+	
+	if (first->avgCPS != second->avgCPS)
+	{
+		return first->avgCPS < second->avgCPS ? 1 : -1;
+	}
+	
+	return (first->varianceCPS > second->varianceCPS) - (first->varianceCPS < second->varianceCPS);
+}
+
+//ranks candidates for the report; plans that did the same go shortest max green, gap-out and threshold first
+int compareCandidates (const void *a, const void *b)
+{
+	const struct SweepCandidate *first = a;
+	const struct SweepCandidate *second = b;
+	int result = compareResults(first, second);
+	
+	if (result != 0)
+	{
+		return result;
+	}
+	
+	if (first->maxGreen != second->maxGreen)
+	{
+		return first->maxGreen > second->maxGreen ? 1 : -1;
+	}
+	
+	if (first->gapOut != second->gapOut)
+	{
+		return first->gapOut > second->gapOut ? 1 : -1;
+	}
+	
+	return (first->threshold > second->threshold) - (first->threshold < second->threshold);
+}
+
+bool writeSweepReport (char filename[], struct SweepCandidate candidates[], int numCandidates)
+{
+	struct ReportBuffer report = {NULL, 0, 0, -1, true, ""};
+	char fullFilename[200];
+	snprintf(fullFilename, sizeof(fullFilename), "%s_SWEEP.stat", filename);
+	
+	if (!reportOpen(&report, fullFilename, 512 + sweepRanked*256))
+	{
+		free(report.data);
+		return false;
+	}
+	
+	reportPrintf(&report, "Timing Plan Sweep\r\nx--------x--------x-------x--------x\r\n\r\n");
+	reportPrintf(&report, "Plans Tried: %d\r\n", numCandidates);
+	reportPrintf(&report, "Control Strategy: %s\r\n", controlStrategyName);
+	reportPrintf(&report, "Time Saved Against: %f s\r\n\r\n", baselineGreenTime);
+	
+	int rank = 0;
+	
+	for (int i = 0; i < numCandidates && i < sweepRanked; i++)
+	{
+		//plans that did exactly as well share a rank
+		if (i == 0 || compareResults(&candidates[i], &candidates[i - 1]) != 0)
+		{
+			rank = i + 1;
+		}
+		
+		reportPrintf(&report, "Rank #%d: \r\n", rank);
+		reportPrintf(&report, "Max Green: %f s\r\nGap-Out: %f s\r\nThreshold: %f cm\r\n", candidates[i].maxGreen, candidates[i].gapOut, candidates[i].threshold);
+		reportPrintf(&report, "Time Saved: %f s per simulated s\r\nAverage Cars Per Second: %f cps\r\nVariance Cars Per Second: %f\r\n", candidates[i].timeSaved, candidates[i].avgCPS, candidates[i].varianceCPS);
+		reportPrintf(&report, "Average Delay: %f s\r\n\r\n", candidates[i].averageDelay);
+	}
+	
+	bool ok = reportClose(&report);
+	free(report.data);
+	
+	return ok;
+}
+
+//set up a simulated intersection from its table on its own backend; leaves that backend active on this thread
+void initSimIntersection (struct SimIntersection *node, const struct ControlStrategy *strategy, unsigned int seed, float threshold, int maxIntervals)
+{
+	node->backend = createSimBackend(seed);
+	backend = node->backend;
+	
+	for (int i = 0; i < node->table.numApproaches; i++)
+	{
+		struct Approach *approach = &node->table.approaches[i];
+		
+		initIntervalStore(&approach->intervals, maxIntervals, NULL);
+		initAccumulator(&approach->stats);
+		backend->addApproach(backend, approach->sensorIn, approach->greenPort, approach->arrivalRate);
+	}
+	
+	startSamplers(node->samplers, &node->table, threshold, false);
+	controllerInit(&node->controller, &node->table, strategy, node->samplers, false);
+}
+
+void freeSimIntersection (struct SimIntersection *node)
+{
+	for (int i = 0; i < node->table.numApproaches; i++)
+	{
+		freeAccumulator(&node->table.approaches[i].stats);
+		freeIntervalStore(&node->table.approaches[i].intervals);
+	}
+	
+	free(node->outbox[0].times);
+	free(node->outbox[1].times);
+	freeController(&node->controller);
+	destroySimBackend(node->backend);
+}
+
+//how well the control loop and every sampler kept to their deadlines
+bool writeTimingReport (char filename[], struct Controller *ctrl)
+{
+	struct ReportBuffer report = {NULL, 0, 0, -1, true, ""};
+	char fullFilename[200];
+	snprintf(fullFilename, sizeof(fullFilename), "%s_TIMING.stat", filename);
+	
+	if (!reportOpen(&report, fullFilename, 512 + (MAX_APPROACHES + 1)*256))
+	{
+		free(report.data);
+		return false;
+	}
+	
+	reportPrintf(&report, "Loop Timing\r\nx--------x--------x-------x--------x\r\n\r\n");
+	reportPrintf(&report, "Sample Period: %u us\r\n", samplePeriod);
+	reportPrintf(&report, "Controller Lateness Budget: %lld ns\r\n\r\n", latenessBudget);
+	
+	writeTiming(&report, "Controller", &ctrl->timing);
+	
+	for (int i = 0; i < ctrl->table->numApproaches; i++)
+	{
+		//samplers the controller ran itself are already counted in its events
+		if (ctrl->samplers[i].threaded)
+		{
+			writeTiming(&report, ctrl->table->approaches[i].name, &ctrl->samplers[i].timing);
+		}
+	}
+	
+	bool ok = reportClose(&report);
+	free(report.data);
+	
+	return ok;
+}
+
+//every report of a finished run (or of one period of a daemon) under the current date
+void writeReports (struct Controller *ctrl)
+{
+	struct PhaseTable *table = ctrl->table;
+	struct StatsOverSimulation statsSim[MAX_APPROACHES];
+	
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		statsSim[i] = snapshotAccumulator(&table->approaches[i].stats, baselineGreenTime);
+	}
+	
+	writeStatsToFile (date, table->approaches, table->numApproaches, statsSim);
+	writeStrategyReport (date, ctrl, statsSim);
+	writeTimingReport (date, ctrl);
+#ifndef TRAFFIC_NO_LATENCY
+	writeLatencyReport (date);
+#endif
+	
+	if (ctrl->windows != NULL)
+	{
+		writeWindowReport (date, ctrl);
+	}
+	
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		freeStatsOverSimulation(&statsSim[i]);
+	}
+}
+
+void writeTiming (struct ReportBuffer *report, const char *name, struct TimingStats *timing)
+{
+	reportPrintf(report, "%s Deadlines: %ld\r\n", name, timing->count);
+	reportPrintf(report, "%s Missed Deadlines: %ld\r\n", name, timing->missed);
+	reportPrintf(report, "%s Average Lateness: %f ns\r\n", name, timing->meanLateness);
+	reportPrintf(report, "%s Maximum Lateness: %lld ns\r\n", name, timing->maxLateness);
+	reportPrintf(report, "%s Jitter (Standard Deviation): %f ns\r\n\r\n", name, timing->count > 0 ? sqrt(timing->m2Lateness/timing->count) : 0);
+}
+
+struct MetricsSegment *openMetrics (const char *path, struct PhaseTable *table)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	
+	if (fd < 0)
+	{
+		return NULL;
+	}
+	
+	if (ftruncate(fd, sizeof(struct MetricsSegment)) != 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	
+	struct MetricsSegment *metrics = mmap(NULL, sizeof(struct MetricsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);	//the mapping keeps the file
+	
+	if (metrics == MAP_FAILED)
+	{
+		return NULL;
+	}
+	
+	atomic_init(&metrics->sequence, 0);
+	metrics->version = metricsVersion;
+	metrics->pid = getpid();
+	metrics->data.numApproaches = table->numApproaches;
+	metrics->data.phase = -1;
+	
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		strcpy(metrics->data.approaches[i].name, table->approaches[i].name);
+	}
+	
+	//readers ignore the segment until the magic is there
+	atomic_thread_fence(memory_order_release);
+	metrics->magic = metricsMagic;
+	
+	return metrics;
+}
+
+//copy the controller's counters into its segment; only the controller's thread writes it
+void publishMetrics (struct Controller *ctrl)
+{
+	struct MetricsSegment *metrics = ctrl->metrics;
+	
+	if (metrics == NULL)
+	{
+		return;
+	}
+	
+	struct PhaseTable *table = ctrl->table;
+	struct Metrics *data = &metrics->data;
+	unsigned int sequence = atomic_load_explicit(&metrics->sequence, memory_order_relaxed);
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	atomic_store_explicit(&metrics->sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	
+	data->updated = ts.tv_sec*1000000000LL + ts.tv_nsec;
+	data->phase = ctrl->currentPhase;
+	data->greenMask = ctrl->phaseActive ? table->phases[ctrl->currentPhase].greenMask : 0;
+	data->phaseElapsed = ctrl->phaseActive ? (backend->now(backend) - ctrl->timerMain)/1e9 : 0;
+	
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		struct MetricsApproach *approach = &data->approaches[i];
+		
+		approach->cars = ctrl->arrivals[i];
+		approach->carsThisGreen = (data->greenMask & (1u << i)) ? ctrl->carCounter[i] : 0;
+		approach->lastCPS = ctrl->lastCPS[i];
+		approach->noEchoes = ctrl->detectors[i].noEchoes;
+		approach->timeouts = ctrl->detectors[i].timeouts;
+		approach->samplesDropped = atomic_load_explicit(&ctrl->samplers[i].queue.dropped, memory_order_relaxed);
+	}
+	
+	data->events = ctrl->timing.count;
+	data->missed = ctrl->timing.missed;
+	data->meanLateness = ctrl->timing.meanLateness;
+	data->jitter = ctrl->timing.count > 0 ? sqrt(ctrl->timing.m2Lateness/ctrl->timing.count) : 0;
+	data->maxLateness = ctrl->timing.maxLateness;
+	data->logDropped = atomic_load_explicit(&logger.dropped, memory_order_relaxed);
+	
+	atomic_store_explicit(&metrics->sequence, sequence + 2, memory_order_release);
+}
+
+//leave the last counters in place for whoever looks later, marked as stopped
+void closeMetrics (struct MetricsSegment *metrics)
+{
+	if (metrics == NULL)
+	{
+		return;
+	}
+	
+	unsigned int sequence = atomic_load_explicit(&metrics->sequence, memory_order_relaxed);
+	
+	atomic_store_explicit(&metrics->sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	metrics->data.phase = -1;
+	metrics->data.greenMask = 0;
+	atomic_store_explicit(&metrics->sequence, sequence + 2, memory_order_release);
+	
+	munmap(metrics, sizeof(struct MetricsSegment));
+}
+
+//take a consistent copy of the counters; false if the segment isn't a metrics segment of this version
+bool readMetrics (struct MetricsSegment *metrics, struct Metrics *snapshot)
+{
+	if (metrics->magic != metricsMagic || metrics->version != metricsVersion)
+	{
+		return false;
+	}
+	
+	unsigned int before;
+	unsigned int after;
+	
+	do
+	{
+		before = atomic_load_explicit(&metrics->sequence, memory_order_acquire);
+		memcpy(snapshot, &metrics->data, sizeof(struct Metrics));
+		atomic_thread_fence(memory_order_acquire);
+		after = atomic_load_explicit(&metrics->sequence, memory_order_relaxed);
+	}
+	while ((before & 1) || before != after);
+	
+	return true;
+}
+
+//print a line of a running controller's counters every second; count lines, or forever when 0
+int runMonitor (const char *path, int count)
+{
+	int fd = open(path, O_RDONLY);
+	
+	if (fd < 0)
+	{
+		fprintf(stderr, "Could not open metrics %s\n", path);
+		return 1;
+	}
+	
+	struct MetricsSegment *metrics = mmap(NULL, sizeof(struct MetricsSegment), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	
+	if (metrics == MAP_FAILED)
+	{
+		fprintf(stderr, "Could not map metrics %s\n", path);
+		return 1;
+	}
+	
+	struct Metrics snapshot;
+	
+	for (int line = 0; count == 0 || line < count; line++)
+	{
+		if (line > 0)
+		{
+			usleep(monitorPeriod);
+		}
+		
+		if (!readMetrics(metrics, &snapshot))
+		{
+			fprintf(stderr, "%s is not a version %u metrics segment\n", path, metricsVersion);
+			munmap(metrics, sizeof(struct MetricsSegment));
+			return 1;
+		}
+		
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		long long age = ts.tv_sec*1000000000LL + ts.tv_nsec - snapshot.updated;
+		
+		if (snapshot.phase < 0)
+		{
+			printf("stopped");
+		}
+		else
+		{
+			printf("phase %d %.1fs%s", snapshot.phase, snapshot.phaseElapsed, age > monitorStale ? " (stale)" : "");
+		}
+		
+		for (int i = 0; i < snapshot.numApproaches && i < MAX_APPROACHES; i++)
+		{
+			struct MetricsApproach *approach = &snapshot.approaches[i];
+			
+			printf(" | %s%s cars %d (%d) cps %.3f no-echo %ld timeout %ld dropped %u", approach->name, (snapshot.greenMask & (1u << i)) ? "*" : "",
+				approach->cars, approach->carsThisGreen, approach->lastCPS, approach->noEchoes, approach->timeouts, approach->samplesDropped);
+		}
+		
+		printf(" | events %ld missed %ld jitter %.3f ms max %.3f ms | log drops %lu\n", snapshot.events, snapshot.missed,
+			snapshot.jitter/1e6, snapshot.maxLateness/1e6, snapshot.logDropped);
+		fflush(stdout);
+	}
+	
+	munmap(metrics, sizeof(struct MetricsSegment));
+	
+	return 0;
+}
+
+#ifndef TRAFFIC_NO_LATENCY
+//the monotonic clock through the vDSO: no system call, and unlike a cycle counter it is readable from
+//user space on the Omega's MIPS core
+static inline long long latencyNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+void recordLatency(struct LatencyHistogram *histogram, long long latency)
+{
+	if (latency < 0)
+	{
+		latency = 0;
+	}
+	
+	atomic_fetch_add_explicit(&histogram->counts[latencyBucket(latency)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&histogram->total, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&histogram->sum, latency, memory_order_relaxed);
+	
+	long long max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+	
+	while (latency > max && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, latency, memory_order_relaxed, memory_order_relaxed));
+}
+
+//values below 16 have a bucket each; above, the exponent picks a group of 16 and the next four bits the bucket in it
+int latencyBucket(long long latency)
+{
+	if (latency < (1 << LATENCY_SUB_BITS))
+	{
+		return latency;
+	}
+	
+	int exponent = 63 - __builtin_clzll(latency);
+	
+	if (exponent > LATENCY_MAX_EXPONENT)
+	{
+		return LATENCY_BUCKETS - 1;
+	}
+	
+	int sub = (latency >> (exponent - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1);
+	
+	return ((exponent - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + sub;
+}
+
+//smallest latency that falls into the bucket
+long long latencyBucketStart(int bucket)
+{
+	if (bucket < (1 << LATENCY_SUB_BITS))
+	{
+		return bucket;
+	}
+	
+	int exponent = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+	long long sub = bucket & ((1 << LATENCY_SUB_BITS) - 1);
+	
+	return ((1LL << LATENCY_SUB_BITS) + sub) << (exponent - LATENCY_SUB_BITS);
+}
+
+//largest latency of the bucket holding the given percentile, so the tail is never understated
+long long latencyPercentile(struct LatencyHistogram *histogram, double percentile)
+{
+	unsigned long total = atomic_load(&histogram->total);
+	unsigned long wanted = ceil(total*percentile/100);
+	unsigned long seen = 0;
+	
+	for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+	{
+		seen += atomic_load_explicit(&histogram->counts[bucket], memory_order_relaxed);
+		
+		if (seen >= wanted && seen > 0)
+		{
+			long long end = bucket + 1 < LATENCY_BUCKETS ? latencyBucketStart(bucket + 1) - 1 : LLONG_MAX;
+			long long max = atomic_load(&histogram->max);
+			
+			return end < max ? end : max;
+		}
+	}
+	
+	return 0;
+}
+
+bool writeLatencyReport(char filename[])
+{
+	struct ReportBuffer report = {NULL, 0, 0, -1, true, ""};
+	char fullFilename[200];
+	snprintf(fullFilename, sizeof(fullFilename), "%s_LATENCY.stat", filename);
+	
+	if (!reportOpen(&report, fullFilename, 4096))
+	{
+		free(report.data);
+		return false;
+	}
+	
+	const double percentiles[] = {50, 90, 99, 99.9};
+	
+	reportPrintf(&report, "Stage Latency\r\nx--------x--------x-------x--------x\r\n\r\n");
+	
+	for (int stage = 0; stage < LATENCY_STAGES; stage++)
+	{
+		struct LatencyHistogram *histogram = &latencyStages[stage];
+		const char *name = latencyStageNames[stage];
+		unsigned long total = atomic_load(&histogram->total);
+		
+		reportPrintf(&report, "%s Samples: %lu\r\n", name, total);
+		
+		if (total == 0)
+		{
+			reportPrintf(&report, "\r\n");
+			continue;
+		}
+		
+		reportPrintf(&report, "%s Average: %f ns\r\n", name, (double)atomic_load(&histogram->sum)/total);
+		
+		for (int i = 0; i < 4; i++)
+		{
+			reportPrintf(&report, "%s %gth Percentile: %lld ns\r\n", name, percentiles[i], latencyPercentile(histogram, percentiles[i]));
+		}
+		
+		reportPrintf(&report, "%s Maximum: %lld ns\r\n", name, (long long)atomic_load(&histogram->max));
+		
+		//the non-empty buckets, by the smallest latency each one holds
+		for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+		{
+			unsigned long count = atomic_load_explicit(&histogram->counts[bucket], memory_order_relaxed);
+			
+			if (count > 0)
+			{
+				reportPrintf(&report, "%s From %lld ns: %lu\r\n", name, latencyBucketStart(bucket), count);
+			}
+		}
+		
+		reportPrintf(&report, "\r\n");
+	}
+	
+	bool ok = reportClose(&report);
+	free(report.data);
+	
+	return ok;
+}
+#endif
+
+//Run the controller until SIGTERM or SIGINT. Every rotationTime seconds the period's files are written
+//and a new set is started, named after the time the period starts; the rolling windows carry on across
+//periods. Only the running period's intervals are held, so memory doesn't grow with the run.
+int runDaemon (struct Controller *ctrl, int rotationTime)
+{
+	struct PhaseTable *table = ctrl->table;
+	time_t wallStart = time(NULL);
+	long long start = backend->now(backend);
+	long long period = rotationTime*1000000000LL;
+	long long rotation = start + period;
+	
+	ctrl->windows = malloc(table->numApproaches*sizeof(struct RollingWindows));
+	
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		initWindows(&ctrl->windows[i], start/60000000000LL);
+	}
+	
+	signal(SIGTERM, requestStop);
+	signal(SIGINT, requestStop);
+	
+	while (!stopRequested)
+	{
+		controllerStep(ctrl);
+		
+		long long now = backend->now(backend);
+		
+		if (now < rotation)
+		{
+			continue;
+		}
+		
+		//name the next period by the wall clock, which runs with virtual time in a simulation
+		char nextDate[80];
+		time_t periodStart = wallStart + (now - start)/1000000000LL;
+		strftime(nextDate, sizeof(nextDate), "%F_%I:%M%p", localtime(&periodStart));
+		
+		rotateOutput(ctrl, nextDate);
+		
+		//skip any periods missed while writing, in one step
+		rotation = now + period - (now - rotation) % period;
+	}
+	
+	return 0;
+}
+
+//write out the period that just ended and start the next one under nextDate
+void rotateOutput (struct Controller *ctrl, const char *nextDate)
+{
+	struct PhaseTable *table = ctrl->table;
+	
+	writeReports(ctrl);
+	
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		freeAccumulator(&table->approaches[i].stats);
+		clearIntervalStore(&table->approaches[i].intervals);
+	}
+	
+	//the period's intervals are in its stats files now; the next period gets a journal of its own
+	if (ctrl->journal != NULL)
+	{
+		const char *path = ctrl->journal->path;
+		int syncEvery = ctrl->journal->syncEvery;
+		
+		closeJournal(ctrl->journal, true);
+		ctrl->journal = openJournal(path, table, syncEvery);
+	}
+	
+	//the log moves on with the other files
+	char tag[80];
+	strcpy(tag, nextDate);
+	writeToLog(date, logDegree, 19, tag, 0);
+	stopLogger();
+	strcpy(date, nextDate);
+}
+
+void requestStop (int signum)
+{
+	stopRequested = 1;
+}
+
+void initWindows (struct RollingWindows *windows, long long minute)
+{
+	memset(windows, 0, sizeof(struct RollingWindows));
+	
+	for (int b = 0; b < WINDOW_BUCKETS; b++)
+	{
+		windows->buckets[b].minute = -1;
+	}
+	
+	//the backend clock starts at zero or later, so no window reaches back before minute 0
+	for (int w = 0; w < NUM_WINDOWS; w++)
+	{
+		windows->totals[w].from = minute - windowMinutes[w] + 1 > 0 ? minute - windowMinutes[w] + 1 : 0;
+	}
+	
+	windows->minute = minute;
+}
+
+//slide every window forward to end at minute, taking out the buckets that drop off the back
+void windowAdvance (struct RollingWindows *windows, long long minute)
+{
+	if (minute <= windows->minute)
+	{
+		return;
+	}
+	
+	for (int w = 0; w < NUM_WINDOWS; w++)
+	{
+		struct WindowTotals *totals = &windows->totals[w];
+		long long from = minute - windowMinutes[w] + 1 > 0 ? minute - windowMinutes[w] + 1 : 0;
+		
+		if (from - totals->from >= WINDOW_BUCKETS)
+		{
+			//idle longer than the ring: everything it counted has gone
+			memset(totals, 0, sizeof(struct WindowTotals));
+		}
+		else
+		{
+			for (long long m = totals->from; m < from; m++)
+			{
+				struct WindowBucket *bucket = &windows->buckets[m % WINDOW_BUCKETS];
 				
-				while (!done)
+				if (bucket->minute == m)
 				{
-					if (carPassed(SENS_N_IN, SENS_N_OUT, defaultThreshold))
-					{
-						carCounter++;
-						writeToLog(date, logDegree, 8, 0, 0);
-						timerOpti = timeUpdate();
-					}
-					if (deltaTime(timerMain) > defaultTimeInterval)
-					{
-						done = true;
-						intervalStat.numCars = carCounter;
-						intervalStat.timeInterval = defaultTimeInterval;
-						intervalStat.cps = calcCarsPerSecond(intervalStat);
-						north[sizeNorth] = intervalStat;
-						sizeNorth++;
-						
-						//Log appropriate interval information
-						writeToLog(date, logDegree, 4, northTag, 0);
-						writeToLog(date, logDegree, 5, northTag, defaultTimeInterval);
-						writeToLog(date, logDegree, 14, northTag, carCounter);
-						writeToLog(date, logDegree, 6, northTag, intervalStat.cps);
-
-					}
-					else if (deltaTime(timerOpti) > 10)
-					{
-						done = true;
-						intervalStat.numCars = carCounter;
-						intervalStat.timeInterval = deltaTime(timerMain);
-						intervalStat.cps = calcCarsPerSecond(intervalStat);
-						north[sizeNorth] = intervalStat;
-						sizeNorth++;
-						
-						//Log appropriate interval information
-						writeToLog(date, logDegree, 4, northTag, defaultTimeInterval - intervalStat.timeInterval);
-						writeToLog(date, logDegree, 5, northTag, intervalStat.timeInterval);
-						writeToLog(date, logDegree, 14, northTag, carCounter);
-						writeToLog(date, logDegree, 6, northTag, intervalStat.cps);
-					}
-					
-					usleep(100000);
+					totals->intervals -= bucket->intervals;
+					totals->cars -= bucket->cars;
+					totals->time -= bucket->time;
+					totals->cps -= bucket->cps;
+					totals->cpsSquares -= bucket->cpsSquares;
 				}
-				
-				currentState = 'w';
-				
-				break;
-			
-			case 'w':
+			}
+		}
+		
+		totals->from = from;
+	}
+	
+	windows->minute = minute;
+}
+
+void windowAdd (struct RollingWindows *windows, struct StatsOverInterval interval, long long minute)
+{
+	windowAdvance(windows, minute);
+	
+	struct WindowBucket *bucket = &windows->buckets[minute % WINDOW_BUCKETS];
+	
+	//the slot last held a minute every window has slid past
+	if (bucket->minute != minute)
+	{
+		memset(bucket, 0, sizeof(struct WindowBucket));
+		bucket->minute = minute;
+		bucket->minCars = INT_MAX;
+		bucket->minCPS = INFINITY;
+	}
+	
+	bucket->intervals++;
+	bucket->cars += interval.numCars;
+	float time = TIME_TO_SECONDS(interval.timeInterval);
+	float cps = CPS_TO_FLOAT(interval.cps);
+	
+	bucket->time += time;
+	bucket->cps += cps;
+	bucket->cpsSquares += (double)cps*cps;
+	bucket->maxCars = interval.numCars > bucket->maxCars ? interval.numCars : bucket->maxCars;
+	bucket->minCars = interval.numCars < bucket->minCars ? interval.numCars : bucket->minCars;
+	bucket->maxCPS = fmaxf(bucket->maxCPS, cps);
+	bucket->minCPS = fminf(bucket->minCPS, cps);
+	
+	for (int w = 0; w < NUM_WINDOWS; w++)
+	{
+		struct WindowTotals *totals = &windows->totals[w];
+		
+		totals->intervals++;
+		totals->cars += interval.numCars;
+		totals->time += time;
+		totals->cps += cps;
+		totals->cpsSquares += (double)cps*cps;
+	}
+}
+
+//the windows as they stand now; maxima and minima come from the buckets, the rest from the totals
+bool writeWindowReport (char filename[], struct Controller *ctrl)
+{
+	struct ReportBuffer report = {NULL, 0, 0, -1, true, ""};
+	char fullFilename[200];
+	snprintf(fullFilename, sizeof(fullFilename), "%s_WINDOWS.stat", filename);
+	
+	if (!reportOpen(&report, fullFilename, 128 + (size_t)ctrl->table->numApproaches*NUM_WINDOWS*800))
+	{
+		free(report.data);
+		return false;
+	}
+	
+	struct PhaseTable *table = ctrl->table;
+	long long minute = backend->now(backend)/60000000000LL;
+	
+	reportPrintf(&report, "Rolling Windows\r\nx--------x--------x-------x--------x\r\n\r\n");
+	
+	for (int i = 0; i < table->numApproaches; i++)
+	{
+		struct RollingWindows *windows = &ctrl->windows[i];
+		const char *name = table->approaches[i].name;
+		
+		windowAdvance(windows, minute);
+		
+		for (int w = 0; w < NUM_WINDOWS; w++)
+		{
+			struct WindowTotals *totals = &windows->totals[w];
+			int maxCars = 0;
+			int minCars = 0;
+			float maxCPS = 0;
+			float minCPS = 0;
+			bool first = true;
 			
-				light_on(GRN_W);
-				light_off(RED_W);
-				light_on(RED_N);
-				light_off(GRN_N);
-				
-				done = false;
-				timerMain = timeUpdate();
-				timerOpti = timeUpdate();
-				carCounter = 0;
+			for (long long m = totals->from; m <= windows->minute; m++)
+			{
+				struct WindowBucket *bucket = &windows->buckets[m % WINDOW_BUCKETS];
 				
-				while (!done)
+				if (bucket->minute != m || bucket->intervals == 0)
 				{
-					if (carPassed(SENS_W_IN, SENS_W_OUT, defaultThreshold))
-					{
-						carCounter++;
-						writeToLog(date, logDegree, 8, 0, 0);
-						timerOpti = timeUpdate();
-					}
-					if (deltaTime(timerMain) > defaultTimeInterval)
-					{
-						done = true;
-						intervalStat.numCars = carCounter;
-						intervalStat.timeInterval = defaultTimeInterval;
-						intervalStat.cps = calcCarsPerSecond(intervalStat);
-						west[sizeWest] = intervalStat;
-						sizeWest++;
-						
-						//Log appropriate interval information
-						writeToLog(date, logDegree, 4, westTag, 0);
-						writeToLog(date, logDegree, 5, westTag, defaultTimeInterval);
-						writeToLog(date, logDegree, 14, westTag, carCounter);
-						writeToLog(date, logDegree, 6, westTag, intervalStat.cps);
-
-					}
-					else if (deltaTime(timerOpti) > 10)
-					{
-						done = true;
-						intervalStat.numCars = carCounter;
-						intervalStat.timeInterval = deltaTime(timerMain);
-						intervalStat.cps = calcCarsPerSecond(intervalStat);
-						west[sizeWest] = intervalStat;
-						sizeWest++;
-						
-						//Log appropriate interval information
-						writeToLog(date, logDegree, 4, westTag, defaultTimeInterval - intervalStat.timeInterval);
-						writeToLog(date, logDegree, 5, westTag, intervalStat.timeInterval);
-						writeToLog(date, logDegree, 14, westTag, carCounter);
-						writeToLog(date, logDegree, 6, westTag, intervalStat.cps);
-					}
-					
-					usleep(100000);
+					continue;
 				}
 				
-				currentState = 'n';
-				
-				break;
+				maxCars = first || bucket->maxCars > maxCars ? bucket->maxCars : maxCars;
+				minCars = first || bucket->minCars < minCars ? bucket->minCars : minCars;
+				maxCPS = first || bucket->maxCPS > maxCPS ? bucket->maxCPS : maxCPS;
+				minCPS = first || bucket->minCPS < minCPS ? bucket->minCPS : minCPS;
+				first = false;
+			}
+			
+			int count = totals->intervals;
+			double meanCPS = count > 0 ? totals->cps/count : 0;
+			double variance = count > 0 ? totals->cpsSquares/count - meanCPS*meanCPS : 0;
+			
+			reportPrintf(&report, "%s %s Intervals: %d\r\n", name, windowNames[w], count);
+			reportPrintf(&report, "%s %s Total Cars: %ld\r\n", name, windowNames[w], totals->cars);
+			reportPrintf(&report, "%s %s Total Time: %f s\r\n", name, windowNames[w], totals->time);
+			reportPrintf(&report, "%s %s Max Cars: %d\r\n", name, windowNames[w], maxCars);
+			reportPrintf(&report, "%s %s Min Cars: %d\r\n", name, windowNames[w], minCars);
+			reportPrintf(&report, "%s %s Average Cars: %f\r\n", name, windowNames[w], count > 0 ? (double)totals->cars/count : 0);
+			reportPrintf(&report, "%s %s Maximum Cars Per Second: %f cps\r\n", name, windowNames[w], maxCPS);
+			reportPrintf(&report, "%s %s Minimum Cars Per Second: %f cps\r\n", name, windowNames[w], minCPS);
+			reportPrintf(&report, "%s %s Average Cars Per Second: %f cps\r\n", name, windowNames[w], meanCPS);
+			reportPrintf(&report, "%s %s Population Standard Deviation Cars Per Second: %f cps\r\n", name, windowNames[w], variance > 0 ? sqrt(variance) : 0);
+			reportPrintf(&report, "%s %s Time Saved: %f s\r\n\r\n", name, windowNames[w], count*baselineGreenTime - totals->time);
 		}
 	}
 	
+	bool ok = reportClose(&report);
+	free(report.data);
+	
+	return ok;
+}
 
-	light_off(GRN_W);
-	light_off(RED_W);
-	light_off(RED_N);
-	light_off(GRN_N);
-
-	//compute statistics
-	struct StatsOverSimulation simNorth = computeStatsOverSimulation(north, sizeNorth);
-	struct StatsOverSimulation simWest = computeStatsOverSimulation(west, sizeWest);
+//Corridor of intersections in a line: cars that cross an intersection on its first approach drive on
+//to the first approach of the next one, apart from those turning off, and every approach also gets
+//its own random arrivals. Each intersection runs the same controller as main on its own simulated
+//backend. Time advances in epochs of one link travel time, so a car leaving during one epoch can only
+//reach the next intersection in a later one; within an epoch the intersections are independent and run
+//in parallel on workers that steal half of each other's remaining nodes when they run out.
+int runCorridor (struct PhaseTable *table, const struct ControlStrategy *strategy, int simulationTime, int numNodes, unsigned int seed, int numWorkers)
+{
+	struct Corridor corridor;
+	struct Backend *mainBackend = backend;
+	int maxIntervals = envInt("TRAFFIC_MAX_INTERVALS", 0);
 	
-	//write stats to file
-	writeStatsToFile (date, north, sizeNorth, west, sizeWest, simNorth, simWest);
+	if (numNodes < 1 || numWorkers < 1)
+	{
+		fprintf(stderr, "A corridor needs at least one intersection and one worker\n");
+		return 1;
+	}
+	
+	if (numWorkers > numNodes)
+	{
+		numWorkers = numNodes;
+	}
+	
+	memset(&corridor, 0, sizeof(corridor));
+	corridor.numNodes = numNodes;
+	corridor.numWorkers = numWorkers;
+	corridor.numEpochs = ceilf(simulationTime/corridorLinkTime);
+	corridor.nodes = calloc(numNodes, sizeof(struct SimIntersection));
+	corridor.ranges = aligned_alloc(64, numWorkers*sizeof(struct WorkRange));
+	atomic_init(&corridor.steals, 0);
+	
+	if (corridor.nodes == NULL || corridor.ranges == NULL)
+	{
+		fprintf(stderr, "Not enough memory for %d intersections\n", numNodes);
+		return 1;
+	}
+	
+	char nodesTag[] = "Corridor intersections";
+	writeToLog(date, logDegree, 13, nodesTag, numNodes);
+	
+	//the logger starts lazily, which only one thread may do
+	if (logDegree > 0 && !logger.started)
+	{
+		startLogger(date);
+	}
+	
+	for (int n = 0; n < numNodes; n++)
+	{
+		struct SimIntersection *node = &corridor.nodes[n];
+		
+		//past the first intersection, random arrivals on the corridor approach only replace the cars turning off
+		node->table = *table;
+		
+		if (n > 0)
+		{
+			node->table.approaches[0].arrivalRate *= corridorTurnOffShare;
+		}
+		
+		initSimIntersection(node, strategy, seed + n*7919, defaultThreshold, maxIntervals);
+		node->turnSeed = seed + n;
+		
+		//the last intersection lets its cars go
+		if (n + 1 < numNodes)
+		{
+			simRecordDepartures(node->backend, 0);
+		}
+	}
+	
+	pthread_barrier_init(&corridor.barrier, NULL, numWorkers);
+	
+	struct CorridorWorker workers[numWorkers];
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	for (int w = 0; w < numWorkers; w++)
+	{
+		workers[w].corridor = &corridor;
+		workers[w].id = w;
+		
+		if (w > 0 && pthread_create(&workers[w].thread, NULL, corridorWorker, &workers[w]) != 0)
+		{
+			fprintf(stderr, "Could not start corridor worker %d\n", w);
+			exit(1);
+		}
+	}
+	
+	corridorWorker(&workers[0]);	//this thread is worker 0
+	
+	for (int w = 1; w < numWorkers; w++)
+	{
+		pthread_join(workers[w].thread, NULL);
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	backend = mainBackend;
+	
+	writeCorridorReport(date, &corridor, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)/1e9);
+	
+	for (int n = 0; n < numNodes; n++)
+	{
+		freeSimIntersection(&corridor.nodes[n]);
+	}
+	
+	pthread_barrier_destroy(&corridor.barrier);
+	free(corridor.ranges);
+	free(corridor.nodes);
 	
-	writeToLog(date, logDegree, 12, 0, 0);
 	return 0;
+}
+
+void *corridorWorker (void *arg)
+{
+	struct CorridorWorker *worker = arg;
+	struct Corridor *corridor = worker->corridor;
+	
+	//each worker starts an epoch owning an even slice of the nodes
+	uint64_t first = (uint64_t)corridor->numNodes*worker->id/corridor->numWorkers;
+	uint64_t last = (uint64_t)corridor->numNodes*(worker->id + 1)/corridor->numWorkers;
+	
+	for (int epoch = 0; epoch < corridor->numEpochs; epoch++)
+	{
+		atomic_store(&corridor->ranges[worker->id].range, first << 32 | last);
+		
+		//nobody steals until every slice is in place
+		pthread_barrier_wait(&corridor->barrier);
+		
+		int index;
+		
+		while ((index = corridorTakeNode(corridor, worker->id)) >= 0)
+		{
+			corridorRunNode(corridor, index, epoch);
+		}
+		
+		//every node has finished the epoch before any car is handed on
+		pthread_barrier_wait(&corridor->barrier);
+	}
+	
+	return NULL;
+}
 
+//next node for a worker: the front of its own range, otherwise the back half of someone else's
+int corridorTakeNode (struct Corridor *corridor, int id)
+{
+	_Atomic uint64_t *own = &corridor->ranges[id].range;
+	uint64_t range = atomic_load(own);
+	
+	while ((range >> 32) < (range & 0xffffffff))
+	{
+		if (atomic_compare_exchange_weak(own, &range, range + (1ull << 32)))
+		{
+			return range >> 32;
+		}
+	}
+	
+	for (int v = 1; v < corridor->numWorkers; v++)
+	{
+		_Atomic uint64_t *victim = &corridor->ranges[(id + v) % corridor->numWorkers].range;
+		range = atomic_load(victim);
+		
+		while ((range >> 32) < (range & 0xffffffff))
+		{
+			uint64_t first = range >> 32;
+			uint64_t last = range & 0xffffffff;
+			uint64_t split = last - (last - first + 1)/2;
+			
+			if (atomic_compare_exchange_weak(victim, &range, first << 32 | split))
+			{
+				//run the first stolen node now and keep the rest as our own range
+				atomic_store(own, (split + 1) << 32 | last);
+				atomic_fetch_add(&corridor->steals, 1);
+				return split;
+			}
+		}
+	}
+	
+	return -1;
 }
 
-bool light_on (const unsigned int port)
+//run one intersection's controller to the end of the epoch
+void corridorRunNode (struct Corridor *corridor, int index, int epoch)
+{
+	struct SimIntersection *node = &corridor->nodes[index];
+	long long epochEnd = (epoch + 1)*secondsToNanos(corridorLinkTime);
+	
+	backend = node->backend;
+	
+	//cars that left the upstream intersection during the last epoch arrive during this one
+	if (index > 0)
+	{
+		struct CorridorLink *inbox = &corridor->nodes[index - 1].outbox[(epoch + 1) % 2];
+		
+		for (int i = 0; i < inbox->size; i++)
+		{
+			simInjectArrival(backend, 0, inbox->times[i]);
+		}
+		
+		inbox->size = 0;
+	}
+	
+	controllerRunUntil(&node->controller, epochEnd);
+	
+	//cars carrying on down the corridor reach the next intersection one link time later
+	if (index + 1 < corridor->numNodes)
+	{
+		struct CorridorLink *outbox = &node->outbox[epoch % 2];
+		long long *departures;
+		int count = simTakeDepartures(backend, 0, &departures);
+		
+		for (int i = 0; i < count; i++)
+		{
+			if (rand_r(&node->turnSeed) < corridorTurnOffShare*RAND_MAX)
+			{
+				continue;
+			}
+			
+			if (outbox->size == outbox->capacity)
+			{
+				outbox->capacity = outbox->capacity > 0 ? outbox->capacity*2 : 64;
+				outbox->times = realloc(outbox->times, outbox->capacity*sizeof(long long));
+			}
+			
+			outbox->times[outbox->size++] = departures[i] + secondsToNanos(corridorLinkTime);
+		}
+	}
+}
+
+bool writeCorridorReport (char filename[], struct Corridor *corridor, double wallSeconds)
+{
+	struct ReportBuffer report = {NULL, 0, 0, -1, true, ""};
+	char fullFilename[200];
+	snprintf(fullFilename, sizeof(fullFilename), "%s_CORRIDOR.stat", filename);
+	
+	if (!reportOpen(&report, fullFilename, 256 + (size_t)corridor->numNodes*512))
+	{
+		free(report.data);
+		return false;
+	}
+	
+	reportPrintf(&report, "Corridor Simulation\r\nx--------x--------x-------x--------x\r\n\r\n");
+	reportPrintf(&report, "Intersections: %d\r\n", corridor->numNodes);
+	reportPrintf(&report, "Workers: %d\r\n", corridor->numWorkers);
+	reportPrintf(&report, "Simulated Time: %f s\r\n", corridor->numEpochs*corridorLinkTime);
+	reportPrintf(&report, "Wall Time: %f s\r\n", wallSeconds);
+	reportPrintf(&report, "Steals: %ld\r\n", atomic_load(&corridor->steals));
+	reportPrintf(&report, "Control Strategy: %s\r\n", corridor->nodes[0].controller.strategy->name);
+	
+	for (int n = 0; n < corridor->numNodes; n++)
+	{
+		struct SimIntersection *node = &corridor->nodes[n];
+		
+		reportPrintf(&report, "\r\nIntersection #%d\r\n", n + 1);
+		
+		for (int a = 0; a < node->table.numApproaches; a++)
+		{
+			struct StatsOverSimulation statsSim = snapshotAccumulator(&node->table.approaches[a].stats, baselineGreenTime);
+			
+			reportPrintf(&report, "%s Total Cars: %d\r\n", node->table.approaches[a].name, statsSim.totalCars);
+			reportPrintf(&report, "%s Average Cars Per Second: %f cps\r\n", node->table.approaches[a].name, statsSim.avgCPS);
+			reportPrintf(&report, "%s Time Saved: %f s\r\n", node->table.approaches[a].name, statsSim.timeSaved);
+			
+			freeStatsOverSimulation(&statsSim);
+		}
+		
+		node->backend->report(node->backend, &report);
+	}
+	
+	bool ok = reportClose(&report);
+	free(report.data);
+	
+	return ok;
+}
+
+//reads every run under the directory on numWorkers threads, each into its own partial, then merges the partials
+int runAggregate (const char *directory, int numWorkers)
+{
+	struct Aggregation aggregation;
+	memset(&aggregation, 0, sizeof(aggregation));
+	
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	strftime(date, 80, "%F_%I:%M%p", localtime(&tv.tv_sec));
+	
+	if (!collectRunFiles(&aggregation, directory))
+	{
+		fprintf(stderr, "Could not read %s\n", directory);
+		return 1;
+	}
+	
+	if (aggregation.numPaths == 0)
+	{
+		fprintf(stderr, "No run output found under %s\n", directory);
+		return 1;
+	}
+	
+	if (numWorkers < 1)
+	{
+		numWorkers = 1;
+	}
+	if (numWorkers > aggregation.numPaths)
+	{
+		numWorkers = aggregation.numPaths;
+	}
+	
+	struct AggregateWorker workers[numWorkers];
+	struct timespec start, end;
+	int started = 1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	memset(workers, 0, sizeof(workers));
+	
+	for (int w = 0; w < numWorkers; w++)
+	{
+		workers[w].aggregation = &aggregation;
+	}
+	
+	for (int w = 1; w < numWorkers; w++, started++)
+	{
+		if (pthread_create(&workers[w].thread, NULL, aggregateWorker, &workers[w]) != 0)
+		{
+			break;
+		}
+	}
+	
+	aggregateWorker(&workers[0]);	//this thread is worker 0
+	
+	//reduce: fold each worker's partial into worker 0's as it finishes
+	for (int w = 1; w < started; w++)
+	{
+		pthread_join(workers[w].thread, NULL);
+		mergePartial(&workers[0].partial, &workers[w].partial);
+		freePartial(&workers[w].partial);
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	
+	//workers meet the approaches in any order
+	qsort(workers[0].partial.approaches, workers[0].partial.numApproaches, sizeof(struct AggregateApproach), compareAggregateApproaches);
+	
+	bool ok = writeAggregateReport(date, directory, &workers[0].partial, &aggregation, started, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)/1e9);
+	
+	freePartial(&workers[0].partial);
+	
+	for (int i = 0; i < aggregation.numPaths; i++)
+	{
+		free(aggregation.paths[i]);
+	}
+	free(aggregation.paths);
+	
+	return ok ? 0 : 1;
+}
+
+//adds the raw and stats files under the directory, and every directory below it, to the aggregation
+bool collectRunFiles (struct Aggregation *aggregation, const char *directory)
 {
-	gpio_set_value(port, 1);  	//set gpio value to high
+	DIR *dir = opendir(directory);
+	struct dirent *entry;
+	
+	if (dir == NULL)
+	{
+		return false;
+	}
+	
+	while ((entry = readdir(dir)) != NULL)
+	{
+		char path[PATH_MAX];
+		struct stat info;
+		
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+			snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name) >= (int)sizeof(path) ||
+			stat(path, &info) != 0)
+		{
+			continue;
+		}
+		
+		if (S_ISDIR(info.st_mode))
+		{
+			collectRunFiles(aggregation, path);
+			continue;
+		}
+		
+		size_t length = strlen(path);
+		bool rawText = length > 12 && strcmp(path + length - 12, "_RAW.rawstat") == 0;
+		bool rawBinary = length > 11 && strcmp(path + length - 11, "_RAW.rawbin") == 0;
+		bool stats = length > 9 && strcmp(path + length - 9, "_SIM.stat") == 0;
+		
+		//a run written with TRAFFIC_RAW_FORMAT=both is read from its binary file only
+		if (rawText && siblingExists(path, "_RAW.rawstat", "_RAW.rawbin"))
+		{
+			continue;
+		}
+		
+		if (stats && !siblingExists(path, "_SIM.stat", "_RAW.rawstat") && !siblingExists(path, "_SIM.stat", "_RAW.rawbin"))
+		{
+			aggregation->statOnly++;
+		}
+		
+		if (!rawText && !rawBinary && !stats)
+		{
+			continue;
+		}
+		
+		if (aggregation->numPaths == aggregation->capacity)
+		{
+			aggregation->capacity = aggregation->capacity == 0 ? 256 : aggregation->capacity*2;
+			aggregation->paths = realloc(aggregation->paths, aggregation->capacity*sizeof(char *));
+		}
+		
+		aggregation->paths[aggregation->numPaths++] = strdup(path);
+	}
+	
+	closedir(dir);
 	
 	return true;
 }
 
-bool light_off (const unsigned int port)
+//whether the file named like path but with its suffix replaced exists
+bool siblingExists (const char *path, const char *suffix, const char *replacement)
 {
-	gpio_set_value(port, 0); 	//set gpio value to low
+	char sibling[PATH_MAX];
+	int stem = strlen(path) - strlen(suffix);
+	struct stat info;
 	
-	return true;
+	if (snprintf(sibling, sizeof(sibling), "%.*s%s", stem, path, replacement) >= (int)sizeof(sibling))
+	{
+		return false;
+	}
+	
+	return stat(sibling, &info) == 0;
 }
 
-int deltaTime(const int oldTime)
+void *aggregateWorker (void *arg)
 {
-	struct timeval tv;
-	gettimeofday(&tv, NULL);  		//get current time
-
-	int currentTime = tv.tv_sec; 		//take the time in seconds
-	int change = currentTime - oldTime; 	//calculate the change in time
+	struct AggregateWorker *worker = arg;
+	struct Aggregation *aggregation = worker->aggregation;
+	int index;
 	
-	return change;
+	while ((index = atomic_fetch_add(&aggregation->next, 1)) < aggregation->numPaths)
+	{
+		const char *path = aggregation->paths[index];
+		size_t length = strlen(path);
+		bool ok;
+		
+		if (strcmp(path + length - 7, ".rawbin") == 0)
+		{
+			ok = aggregateRawBinary(&worker->partial, path);
+		}
+		else if (strcmp(path + length - 8, ".rawstat") == 0)
+		{
+			ok = aggregateRawText(&worker->partial, path);
+		}
+		else
+		{
+			ok = aggregateStatFile(&worker->partial, path);
+		}
+		
+		worker->partial.files++;
+		worker->partial.failed += !ok;
+	}
+	
+	return NULL;
 }
 
-int timeUpdate()
+//the partial's entry for an approach name, added the first time the name is seen
+struct AggregateApproach *aggregateApproach (struct AggregatePartial *partial, const char *name)
 {
-	struct timeval tv;
-	gettimeofday(&tv, NULL);	//get current time
-
-	int newTime = tv.tv_sec;
-	return newTime;			//return the current time
+	for (int a = 0; a < partial->numApproaches; a++)
+	{
+		if (strcmp(partial->approaches[a].name, name) == 0)
+		{
+			return &partial->approaches[a];
+		}
+	}
+	
+	if (partial->numApproaches == partial->capacity)
+	{
+		partial->capacity = partial->capacity == 0 ? MAX_APPROACHES : partial->capacity*2;
+		partial->approaches = realloc(partial->approaches, partial->capacity*sizeof(struct AggregateApproach));
+	}
+	
+	struct AggregateApproach *approach = &partial->approaches[partial->numApproaches++];
+	
+	snprintf(approach->name, sizeof(approach->name), "%s", name);
+	approach->files = 0;
+	initAccumulator(&approach->stats);
+	
+	return approach;
 }
 
-int minutesToSeconds(int minutes)
+//a *_RAW.rawstat file as writeStatsToFile writes it; cps is worked out again from the cars and time
+bool aggregateRawText (struct AggregatePartial *partial, const char *path)
 {
-	return minutes*60;
+	char *contents = readWholeFile(path);
+	char name[16];
+	
+	if (contents == NULL)
+	{
+		return false;
+	}
+	
+	if (sscanf(contents, "Raw Data for %15s Direction", name) != 1)
+	{
+		free(contents);
+		return false;
+	}
+	
+	struct AggregateApproach *approach = aggregateApproach(partial, name);
+	char *position = contents;
+	
+	approach->files++;
+	
+	while ((position = strstr(position, "Number of Cars: ")) != NULL)
+	{
+		struct StatsOverInterval interval;
+		memset(&interval, 0, sizeof(interval));
+		
+		interval.numCars = strtol(position + strlen("Number of Cars: "), &position, 10);
+		position = strstr(position, "Time Interval Length: ");
+		
+		if (position == NULL)
+		{
+			break;
+		}
+		
+		interval.timeInterval = TIME_FROM_SECONDS(strtof(position + strlen("Time Interval Length: "), &position));
+		interval.cps = calcCarsPerSecond(interval);
+		accumulateInterval(&approach->stats, interval);
+	}
+	
+	free(contents);
+	
+	return true;
 }
 
-float readSensor (const unsigned int gpioIn, const unsigned int gpioOut)
+bool aggregateRawBinary (struct AggregatePartial *partial, const char *path)
 {
+	struct RawBinaryView view;
 	
-	float detectedRange = 0;
+	if (!openRawBinary(path, &view))
+	{
+		return false;
+	}
 	
-	//gpioIn reads data from the sensor (Echo)
-	gpio_request(gpioIn, NULL);
-	gpio_direction_input(gpioIn);
+	struct AggregateApproach *approach = aggregateApproach(partial, view.header->direction);
 	
-	//gpioOut requests data from the sensor (Trig)
-	gpio_request(gpioOut, NULL);
-	gpio_direction_output(gpioOut, 0);
+	approach->files++;
 	
-	//Trigger Sensor
-	gpio_set_value(gpioOut, 1);
-	usleep(15);
-	gpio_set_value(gpioOut, 0);
+	for (uint32_t i = 0; i < view.header->count; i++)
+	{
+		struct StatsOverInterval interval = {view.numCars[i], TIME_FROM_SECONDS(view.timeInterval[i]), 0, view.startTime[i]};
+		
+		interval.cps = calcCarsPerSecond(interval);
+		accumulateInterval(&approach->stats, interval);
+	}
 	
-	//Wait for echo
-	int echo = gpio_get_value(gpioIn);
-	int iterations = 0;
+	closeRawBinary(&view);
 	
-	float microsecondCounter = 0;
+	return true;
+}
+
+//the stats are worked out from the raw intervals, so a *_SIM.stat file only says which strategy the run used
+bool aggregateStatFile (struct AggregatePartial *partial, const char *path)
+{
+	char *contents = readWholeFile(path);
+	char strategy[32];
 	
-	while ((echo==0) && (iterations < 5000))
+	if (contents == NULL)
 	{
-		usleep(1);
-		echo = gpio_get_value(gpioIn);
-		iterations++;
+		return false;
 	}
 	
-	//sensor didn't work
-	if (iterations >= 5000)
+	char *line = strstr(contents, "Control Strategy: ");
+	bool ok = line != NULL && sscanf(line, "Control Strategy: %31s", strategy) == 1;
+	
+	if (ok && partial->strategy[0] == 0)
 	{
-		detectedRange = -2;
+		strcpy(partial->strategy, strategy);
 	}
-	//calculate range
-	else
+	else if (ok && strcmp(partial->strategy, strategy) != 0)
 	{
-		microsecondCounter = 0;
-		
-		echo = gpio_get_value(gpioIn);
-		
-		while ((echo != 0) && (microsecondCounter < 32000))
-		{
-			usleep(10);
-			echo = gpio_get_value(gpioIn);
-			microsecondCounter += 10;
-		}
-		
-		//detected nothing
-		if (microsecondCounter >= 32000)
-		{
-			detectedRange = -1;
-		}
-		//find the range in centimeters
-		else
-		{
-			detectedRange = microsecondCounter/58;
-		}
+		strcpy(partial->strategy, "mixed");
 	}
 	
-
-	return detectedRange;
-
+	free(contents);
+	
+	return ok;
 }
 
-bool carPassed(const unsigned int gpioIn, const unsigned int gpioOut, const float threshold)
+void mergePartial (struct AggregatePartial *total, struct AggregatePartial *partial)
 {
-	if (readSensor(gpioIn, gpioOut) <= threshold) //if sensor output is less than threshold
+	for (int a = 0; a < partial->numApproaches; a++)
 	{
-		return true;	//car has passed
+		struct AggregateApproach *approach = aggregateApproach(total, partial->approaches[a].name);
+		
+		approach->files += partial->approaches[a].files;
+		mergeAccumulator(&approach->stats, &partial->approaches[a].stats);
 	}
-	else
+	
+	total->files += partial->files;
+	total->failed += partial->failed;
+	
+	if (total->strategy[0] == 0)
 	{
-		return false;	//no car
+		strcpy(total->strategy, partial->strategy);
+	}
+	else if (partial->strategy[0] != 0 && strcmp(total->strategy, partial->strategy) != 0)
+	{
+		strcpy(total->strategy, "mixed");
 	}
 }
 
-float calcCarsPerSecond (struct StatsOverInterval intervalStats)
+int compareAggregateApproaches (const void *a, const void *b)
 {
-	float cps = intervalStats.numCars/intervalStats.timeInterval;
-	return cps;
+	return strcmp(((const struct AggregateApproach *)a)->name, ((const struct AggregateApproach *)b)->name);
 }
 
-float calcTotalTime (struct StatsOverInterval statsInterval[ ], int sizeStats)
+void freePartial (struct AggregatePartial *partial)
 {
-	float total = 0;
-	for (int i = 0; i < sizeStats; i++)
+	for (int a = 0; a < partial->numApproaches; a++)
 	{
-		total += statsInterval[i].timeInterval;
+		freeAccumulator(&partial->approaches[a].stats);
 	}
-	return total;
+	
+	free(partial->approaches);
+	memset(partial, 0, sizeof(struct AggregatePartial));
 }
 
-int calcTotalCars (struct StatsOverInterval statsInterval[ ], int sizeStats)
+bool writeAggregateReport (char filename[], const char *directory, struct AggregatePartial *total, struct Aggregation *aggregation, int numWorkers, double wallSeconds)
 {
-	int total = 0;
-	for (int i = 0; i < sizeStats; i++)
+	struct ReportBuffer report = {NULL, 0, 0, -1, true, ""};
+	struct StatsOverSimulation statsSim[total->numApproaches > 0 ? total->numApproaches : 1];
+	const char *names[total->numApproaches > 0 ? total->numApproaches : 1];
+	char fullFilename[200];
+	
+	for (int a = 0; a < total->numApproaches; a++)
 	{
-		total += statsInterval[i].numCars;
+		statsSim[a] = snapshotAccumulator(&total->approaches[a].stats, baselineGreenTime);
+		names[a] = total->approaches[a].name;
 	}
-	return total;
+	
+	//the csv and json reports name the strategy the runs used
+	controlStrategyName = total->strategy[0] != 0 ? total->strategy : "unknown";
+	
+	snprintf(fullFilename, sizeof(fullFilename), "%s_AGGREGATE.stat", filename);
+	reportOpen(&report, fullFilename, 512 + total->numApproaches*1024);
+	reportPrintf(&report, "Aggregate Statistics for %s\r\nx--------x--------x-------x--------x\r\n\r\n", directory);
+	reportPrintf(&report, "Files Read: %d\r\n", total->files);
+	reportPrintf(&report, "Unreadable Files: %d\r\n", total->failed);
+	reportPrintf(&report, "Stats Files Without Raw Data: %d\r\n", aggregation->statOnly);
+	reportPrintf(&report, "Workers: %d\r\n", numWorkers);
+	reportPrintf(&report, "Wall Time: %f s\r\n", wallSeconds);
+	reportPrintf(&report, "Control Strategy: %s\r\n", controlStrategyName);
+	
+	for (int a = 0; a < total->numApproaches; a++)
+	{
+		reportPrintf(&report, "\r\n%s Direction\r\n", names[a]);
+		reportPrintf(&report, "Raw Files: %d\r\n", total->approaches[a].files);
+		for (int f = 0; f < numStatFields; f++)
+		{
+			reportPrintf(&report, "%s: ", statFields[f].label);
+			reportStatValue(&report, &statFields[f], &statsSim[a], 't');
+			reportPrintf(&report, "%s\r\n", statFields[f].unit);
+		}
+	}
+	
+	bool ok = reportClose(&report);
+	
+	if (reportCsvOutput)
+	{
+		snprintf(fullFilename, sizeof(fullFilename), "%s_AGGREGATE.csv", filename);
+		ok = writeStatsCsv(&report, fullFilename, names, total->numApproaches, statsSim) && ok;
+	}
+	
+	if (reportJsonOutput)
+	{
+		snprintf(fullFilename, sizeof(fullFilename), "%s_AGGREGATE.json", filename);
+		ok = writeStatsJson(&report, fullFilename, names, total->numApproaches, statsSim) && ok;
+	}
+	
+	for (int a = 0; a < total->numApproaches; a++)
+	{
+		freeStatsOverSimulation(&statsSim[a]);
+	}
+	
+	free(report.data);
+	
+	return ok;
 }
 
-int calcMaxCars (struct StatsOverInterval statsInterval[ ], int sizeStats)
+bool writeRawBinaryFile (char filename[], struct IntervalStore *statsInterval, char direction[])
 {
-	int max = statsInterval[0].numCars;
-	for (int i = 0; i < sizeStats ; i++)
+	char fullFilename[200];
+	char upperDirection[16];
+	int i;
+	
+	for (i = 0; direction[i] != 0 && i < 15; i++)
 	{
-		if (statsInterval[i].numCars > max)
+		upperDirection[i] = toupper((unsigned char)direction[i]);
+	}
+	upperDirection[i] = 0;
+	
+	snprintf(fullFilename, sizeof(fullFilename), "%s_%s_RAW.rawbin", filename, upperDirection);
+	
+	//columns start on 8 byte boundaries after the header
+	uint64_t count = statsInterval->size;
+	struct RawBinaryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "TRAFRAW", 8);
+	header.version = 1;
+	header.count = count;
+	strncpy(header.direction, direction, sizeof(header.direction) - 1);
+	header.startTimeOffset = sizeof(header);
+	header.numCarsOffset = header.startTimeOffset + count*sizeof(int64_t);
+	header.timeIntervalOffset = header.numCarsOffset + ((count*sizeof(int32_t) + 7) & ~7ULL);
+	header.cpsOffset = header.timeIntervalOffset + ((count*sizeof(float) + 7) & ~7ULL);
+	
+	int fd = open(fullFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	
+	if (fd < 0)
+	{
+		return false;
+	}
+	
+	bool ok = write(fd, &header, sizeof(header)) == sizeof(header);
+	
+	for (int column = 0; column < 4 && ok; column++)
+	{
+		ok = writeColumn(fd, statsInterval, column);
+		
+		//pad to the next column's offset
+		off_t position = lseek(fd, 0, SEEK_CUR);
+		uint64_t pad = ((position + 7) & ~7ULL) - position;
+		
+		if (pad > 0 && column < 3)
 		{
-			max = statsInterval[i].numCars;
+			char zeros[8] = {0};
+			ok = ok && write(fd, zeros, pad) == (ssize_t)pad;
 		}
 	}
-	return max;
+	
+	close(fd);
+	
+	if (ok)
+	{
+		writeToLog(date, logDegree, 11, fullFilename, 0);
+	}
+	
+	return ok;
 }
 
-int calcMinCars (struct StatsOverInterval statsInterval[ ], int sizeStats)
+bool writeColumn (int fd, struct IntervalStore *statsInterval, int column)
 {
-	int min = statsInterval[0].numCars;
-	for (int i = 0; i < sizeStats; i++)
+	int perChunk = intervalsPerChunk();
+	char buffer[perChunk*sizeof(int64_t)];
+	
+	//gather one chunk's worth of a single field at a time and write it out in one call
+	for (int chunk = 0; chunk < statsInterval->numChunks; chunk++)
 	{
-		if (statsInterval[i].numCars < min)
+		struct StatsOverInterval *intervals = statsInterval->chunks[chunk];
+		int count = statsInterval->size - chunk*perChunk;
+		size_t bytes = 0;
+		
+		if (count > perChunk)
 		{
-			min = statsInterval[i].numCars;
+			count = perChunk;
+		}
+		
+		for (int i = 0; i < count; i++)
+		{
+			switch (column)
+			{
+				case 0:
+					((int64_t *)buffer)[i] = intervals[i].startTime;
+					bytes += sizeof(int64_t);
+					break;
+				case 1:
+					((int32_t *)buffer)[i] = intervals[i].numCars;
+					bytes += sizeof(int32_t);
+					break;
+				case 2:
+					((float *)buffer)[i] = TIME_TO_SECONDS(intervals[i].timeInterval);
+					bytes += sizeof(float);
+					break;
+				case 3:
+					((float *)buffer)[i] = CPS_TO_FLOAT(intervals[i].cps);
+					bytes += sizeof(float);
+					break;
+			}
+		}
+		
+		if (write(fd, buffer, bytes) != (ssize_t)bytes)
+		{
+			return false;
 		}
 	}
-	return min;
+	
+	return true;
 }
 
-float calcAvgCars (struct StatsOverInterval statsInterval[ ], int sizeStats)
+bool openRawBinary(const char *path, struct RawBinaryView *view)
 {
-	float total = 0;
-	for (int i = 0; i < sizeStats; i++)
+	memset(view, 0, sizeof(struct RawBinaryView));
+	
+	int fd = open(path, O_RDONLY);
+	struct stat info;
+	
+	if (fd < 0)
 	{
-		total += statsInterval[i].numCars;
+		return false;
 	}
-	return total/sizeStats;
+	
+	if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(struct RawBinaryHeader))
+	{
+		close(fd);
+		return false;
+	}
+	
+	view->length = info.st_size;
+	view->map = mmap(NULL, view->length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	
+	if (view->map == MAP_FAILED)
+	{
+		view->map = NULL;
+		return false;
+	}
+	
+	const struct RawBinaryHeader *header = view->map;
+	uint64_t count = header->count;
+	
+	//reject anything that isn't ours or whose columns run past the end of the file
+	if (memcmp(header->magic, "TRAFRAW", 8) != 0 || header->version != 1 ||
+		header->startTimeOffset + count*sizeof(int64_t) > view->length ||
+		header->numCarsOffset + count*sizeof(int32_t) > view->length ||
+		header->timeIntervalOffset + count*sizeof(float) > view->length ||
+		header->cpsOffset + count*sizeof(float) > view->length)
+	{
+		closeRawBinary(view);
+		return false;
+	}
+	
+	view->header = header;
+	view->startTime = (const int64_t *)((const char *)view->map + header->startTimeOffset);
+	view->numCars = (const int32_t *)((const char *)view->map + header->numCarsOffset);
+	view->timeInterval = (const float *)((const char *)view->map + header->timeIntervalOffset);
+	view->cps = (const float *)((const char *)view->map + header->cpsOffset);
+	
+	return true;
 }
 
-float calcAvgTime (struct StatsOverInterval statsInterval[ ], int sizeStats)
+void closeRawBinary(struct RawBinaryView *view)
 {
-	float total = 0;
-	for (int i = 0; i < sizeStats; i++)
+	if (view->map != NULL)
 	{
-		total += statsInterval[i].timeInterval;
+		munmap(view->map, view->length);
 	}
-	return total/sizeStats;
+	
+	memset(view, 0, sizeof(struct RawBinaryView));
 }
 
-int calcModeCars (struct StatsOverInterval statsInterval[], int sizeStats, int modes[])
+struct TraceRecorder *openTrace(const char *path, struct PhaseTable *table)
 {
-	int numModes = 0;
-	
-	int newData[sizeStats];
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
 	
-	for (int i = 0; i < sizeStats; i++)
+	if (fd < 0)
 	{
-		newData[i] = statsInterval[i].numCars;
+		return NULL;
 	}
 	
-	sortInt (newData,sizeStats);
-	
-	int sizeMode = 0;
-	int indexMode = 0;
-	int maxCount = 1;
-	int modeCount = 1;
-	bool firstTime = true;
+	struct TraceHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "TRAFTRC", 8);
+	header.version = 1;
+	header.numSensors = table->numApproaches;
+	header.samplePeriod = samplePeriod;
 	
-	for (int i = 0; i <= sizeStats-1; i++)
+	for (int i = 0; i < table->numApproaches; i++)
 	{
-		if (newData[i] == newData[i+1])
-		{
-			modeCount++;
-			
-			if (modeCount == maxCount)
-			{
-				modes[indexMode] = newData[i];
-				indexMode++;
-				sizeMode++;
-			}
-			if (modeCount > maxCount)
-			{
-				maxCount = modeCount;
-				
-				if (firstTime)
-				{
-					indexMode = 0;
-					sizeMode = 0;
-					modes[indexMode] = newData[i];
-					sizeMode++;
-					indexMode++;
-					
-					firstTime = false;
-				}
-			}
-		}
-		else
-		{
-			if (maxCount == 1)
-			{
-				modes[indexMode] = newData[i];
-				indexMode++;
-				sizeMode++;
-				firstTime = true;
-			}
-			else
-			{
-				modeCount = 1;
-				firstTime = true;
-			}
-		}
-			
+		strcpy(header.names[i], table->approaches[i].name);
+	}
+	
+	if (write(fd, &header, sizeof(header)) != sizeof(header))
+	{
+		close(fd);
+		return NULL;
 	}
 	
-	numModes = sizeMode;
-
-	return numModes;	
+	struct TraceRecorder *trace = calloc(1, sizeof(struct TraceRecorder));
+	trace->fd = fd;
+	atomic_init(&trace->head, 0);
+	atomic_init(&trace->tail, 0);
+	atomic_init(&trace->dropped, 0);
+	atomic_init(&trace->running, true);
+	trace->lossless = backend->virtualTime;	//a virtual clock doesn't care how long writing takes
+	
+	pthread_create(&trace->thread, NULL, traceWriter, trace);
+	
+	return trace;
 }
 
-bool sortInt(int dataset[], const int size)
+//encode one reading into the block being filled; called by the control loop only, never blocks
+void traceRecord(struct TraceRecorder *trace, int sensor, struct RangeSample sample)
 {
-	return selectionInt (dataset, size, 0);
+	unsigned int head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+	struct TraceBlock *block = &trace->blocks[head % TRACE_BLOCKS];
+	
+	if (!trace->filling)
+	{
+		while (trace->lossless && head - atomic_load_explicit(&trace->tail, memory_order_acquire) == TRACE_BLOCKS)
+		{
+			usleep(100);	//let the writer catch up
+		}
+		
+		if (head - atomic_load_explicit(&trace->tail, memory_order_acquire) == TRACE_BLOCKS)
+		{
+			atomic_fetch_add_explicit(&trace->dropped, 1, memory_order_relaxed);	//the writer is behind; lose samples rather than wait
+			return;
+		}
+		
+		block->magic = traceBlockMagic;
+		block->bytes = 0;
+		block->count = 0;
+		memset(trace->lastTime, 0, sizeof(trace->lastTime));
+		memset(trace->lastRange, 0, sizeof(trace->lastRange));
+		trace->filling = true;
+	}
+	
+	int status = sample.range == -1 ? 1 : sample.range < 0 ? 2 : 0;
+	long long time = sample.timestamp/1000;
+	long long timeDelta = time - (trace->lastTime[sensor] != 0 ? trace->lastTime[sensor] + samplePeriod : 0);
+	unsigned char *out = block->data + block->bytes;
+	
+	*out++ = sensor | status << 3;
+	out += putVarint(out, ((uint64_t)timeDelta << 1) ^ (uint64_t)(timeDelta >> 63));
+	trace->lastTime[sensor] = time;
+	
+	if (status == 0)
+	{
+		long range = RANGE_TO_HUNDREDTHS(sample.range);
+		long rangeDelta = range - trace->lastRange[sensor];
+		
+		out += putVarint(out, ((uint64_t)rangeDelta << 1) ^ (uint64_t)((int64_t)rangeDelta >> 63));
+		trace->lastRange[sensor] = range;
+	}
+	
+	block->bytes = out - block->data;
+	block->count++;
+	trace->recorded++;
+	
+	//hand the block over once another sample might not fit
+	if (block->bytes > TRACE_BLOCK_BYTES - TRACE_RECORD_MAX)
+	{
+		trace->filling = false;
+		atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+	}
 }
 
-bool selectionInt(int dataset[], const int size, int index)
+//write out blocks as the control loop fills them, until the recorder is closed and they are all out
+void *traceWriter(void *arg)
 {
-	if (index == size)
-	{
-		return true;
-	}
-	else
+	struct TraceRecorder *trace = arg;
+	
+	while (true)
 	{
-		int min = dataset[index];
-		int posMin = index;
+		bool running = atomic_load(&trace->running);
+		unsigned int tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
 		
-		for (int i = index; i < size; i++)
+		if (tail != atomic_load_explicit(&trace->head, memory_order_acquire))
 		{
-			if (dataset[i] < min)
+			struct TraceBlock *block = &trace->blocks[tail % TRACE_BLOCKS];
+			size_t length = offsetof(struct TraceBlock, data) + block->bytes;
+			
+			if (write(trace->fd, block, length) != (ssize_t)length)
 			{
-				min = dataset[i];
-				posMin = i;
+				atomic_fetch_add_explicit(&trace->dropped, block->count, memory_order_relaxed);
 			}
+			
+			atomic_store_explicit(&trace->tail, tail + 1, memory_order_release);
+		}
+		else if (!running)
+		{
+			break;
+		}
+		else
+		{
+			usleep(20000);
 		}
-		
-		int temp = dataset[index];
-		dataset[index] = dataset[posMin];
-		dataset[posMin] = temp;
-		
-		return selectionInt(dataset, size, index+1);
 	}
+	
+	return NULL;
 }
 
-bool sortFloat(float dataset[], const int size)
+//flush and close the trace; returns the samples it lost
+unsigned long closeTrace(struct TraceRecorder *trace)
 {
-	return selectionFloat (dataset, size, 0);
+	//the block being filled goes out with the rest
+	if (trace->filling)
+	{
+		trace->filling = false;
+		atomic_fetch_add_explicit(&trace->head, 1, memory_order_release);
+	}
+	
+	atomic_store(&trace->running, false);
+	pthread_join(trace->thread, NULL);
+	close(trace->fd);
+	
+	unsigned long dropped = atomic_load(&trace->dropped);
+	free(trace);
+	
+	return dropped;
 }
 
-bool selectionFloat(float dataset[], const int size, int index)
+//LEB128: seven bits a byte, low bits first, top bit set on every byte but the last
+int putVarint(unsigned char *out, uint64_t value)
 {
-	if (index == size)
+	int length = 0;
+	
+	while (value >= 0x80)
 	{
-		return true;
+		out[length++] = (value & 0x7f) | 0x80;
+		value >>= 7;
 	}
-	else
+	
+	out[length++] = value;
+	
+	return length;
+}
+
+bool getVarint(const unsigned char *in, uint32_t length, uint32_t *position, uint64_t *value)
+{
+	*value = 0;
+	
+	for (int shift = 0; shift < 64 && *position < length; shift += 7)
 	{
-		float min = dataset[index];
-		int posMin = index;
+		unsigned char byte = in[(*position)++];
+		*value |= (uint64_t)(byte & 0x7f) << shift;
 		
-		for (int i = index; i < size; i++)
+		if (!(byte & 0x80))
 		{
-			if (dataset[i] < min)
-			{
-				min = dataset[i];
-				posMin = i;
-			}
+			return true;
 		}
-		
-		float temp = dataset[index];
-		dataset[index] = dataset[posMin];
-		dataset[posMin] = temp;
-		
-		return selectionFloat(dataset, size, index+1);
 	}
+	
+	return false;
 }
 
-float calcMaxCPS (struct StatsOverInterval statsInterval[ ], int sizeStats)
+bool openTraceReader(const char *path, struct TraceReader *reader)
 {
-	float max = statsInterval[0].cps;
-	for (int i = 0; i < sizeStats ; i++)
+	memset(reader, 0, sizeof(struct TraceReader));
+	
+	int fd = open(path, O_RDONLY);
+	struct stat info;
+	
+	if (fd < 0)
 	{
-		if (statsInterval[i].cps > max)
-		{
-			max = statsInterval[i].cps;
-		}
+		return false;
 	}
-	return max;
+	
+	if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(struct TraceHeader))
+	{
+		close(fd);
+		return false;
+	}
+	
+	reader->length = info.st_size;
+	reader->map = mmap(NULL, reader->length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	
+	if (reader->map == MAP_FAILED)
+	{
+		reader->map = NULL;
+		return false;
+	}
+	
+	reader->header = reader->map;
+	
+	if (memcmp(reader->header->magic, "TRAFTRC", 8) != 0 || reader->header->version != 1 || reader->header->numSensors > MAX_APPROACHES)
+	{
+		closeTraceReader(reader);
+		return false;
+	}
+	
+	reader->offset = sizeof(struct TraceHeader);
+	
+	return true;
 }
 
-float calcMinCPS (struct StatsOverInterval statsInterval[ ], int sizeStats)
+//decode the next sample; false at the end of the trace or at the first block that is cut short
+bool traceNext(struct TraceReader *reader, int *sensor, struct RangeSample *sample)
 {
-	float min = statsInterval[0].cps;
-	for (int i = 0; i < sizeStats; i++)
+	while (reader->remaining == 0)
 	{
-		if (statsInterval[i].cps < min)
+		size_t headerBytes = offsetof(struct TraceBlock, data);
+		
+		if (reader->offset + headerBytes > reader->length)
 		{
-			min = statsInterval[i].cps;
+			return false;
+		}
+		
+		const char *start = (const char *)reader->map + reader->offset;
+		struct TraceBlock *block = &reader->block;
+		
+		memcpy(block, start, headerBytes);
+		
+		if (block->magic != traceBlockMagic || block->bytes > TRACE_BLOCK_BYTES || reader->offset + headerBytes + block->bytes > reader->length)
+		{
+			return false;
 		}
+		
+		memcpy(block->data, start + headerBytes, block->bytes);
+		reader->offset += headerBytes + block->bytes;
+		reader->position = 0;
+		reader->remaining = block->count;
+		memset(reader->lastTime, 0, sizeof(reader->lastTime));
+		memset(reader->lastRange, 0, sizeof(reader->lastRange));
 	}
-	return min;
+	
+	const struct TraceBlock *block = &reader->block;
+	uint64_t timeDelta;
+	uint64_t rangeDelta;
+	
+	if (reader->position >= block->bytes)
+	{
+		return false;
+	}
+	
+	unsigned char tag = block->data[reader->position++];
+	int index = tag & 7;
+	int status = tag >> 3;
+	
+	if (index >= (int)reader->header->numSensors || !getVarint(block->data, block->bytes, &reader->position, &timeDelta))
+	{
+		return false;
+	}
+	
+	long long time = (long long)(timeDelta >> 1) ^ -(long long)(timeDelta & 1);
+	
+	time += reader->lastTime[index] != 0 ? reader->lastTime[index] + reader->header->samplePeriod : 0;
+	reader->lastTime[index] = time;
+	
+	*sensor = index;
+	sample->timestamp = time*1000;
+	
+	if (status == 1)
+	{
+		sample->range = -1;
+	}
+	else if (status != 0)
+	{
+		sample->range = -2;
+	}
+	else
+	{
+		if (!getVarint(block->data, block->bytes, &reader->position, &rangeDelta))
+		{
+			return false;
+		}
+		
+		reader->lastRange[index] += (long)((int64_t)(rangeDelta >> 1) ^ -(int64_t)(rangeDelta & 1));
+		sample->range = RANGE_FROM_HUNDREDTHS(reader->lastRange[index]);
+	}
+	
+	reader->remaining--;
+	
+	return true;
 }
 
-float calcAverageCPS (struct StatsOverInterval statsInterval[ ], int sizeStats)
+void closeTraceReader(struct TraceReader *reader)
 {
-	float total = 0;
-	for (int i = 0; i < sizeStats; i++)
+	if (reader->map != NULL)
 	{
-		total += statsInterval[i].cps;
+		munmap(reader->map, reader->length);
 	}
-	return total/sizeStats;
+	
+	memset(reader, 0, sizeof(struct TraceReader));
 }
 
-float calcMedianCPS (struct StatsOverInterval statsInterval[ ], int sizeStats)
+int dumpTrace(const char *path)
 {
-	float median;
+	struct TraceReader reader;
 	
-	int j = 0;
-	int i = 0;
-	float set[sizeStats];
-
-	while (j < sizeStats)
+	if (!openTraceReader(path, &reader))
 	{
-		set[j] = statsInterval[j].cps;
-		j++;
+		fprintf(stderr, "Could not read trace %s\n", path);
+		return 1;
 	}
 	
-	sortFloat(set,sizeStats);
+	int sensor;
+	struct RangeSample sample;
 	
-	if (sizeStats % 2 == 0)
-	{
-		median = (set[sizeStats/2] + set[(sizeStats/2)-1])/2;
-	}
-	else
+	printf("timestamp_us,sensor,range\n");
+	
+	while (traceNext(&reader, &sensor, &sample))
 	{
-		median = set[(sizeStats-1)/2];
+		printf("%lld,%s,%.2f\n", sample.timestamp/1000, reader.header->names[sensor], RANGE_TO_CM(sample.range));
 	}
-		
-	return median;
+	
+	closeTraceReader(&reader);
+	
+	return 0;
 }
 
-float calcPopStdDevCPS(struct StatsOverInterval statsInterval[], int sizeStats) 
+//the *_SIM.stat and *_RAW.rawstat files a replay is compared against, two per approach, NULL where missing;
+//read before the replay writes its own, which may have the same names
+char **loadBaseline(const char *prefix, struct PhaseTable *table)
 {
-	float devset[sizeStats];
-	int j = 0;
-	float popdev = 0;
-	while (j < sizeStats)
+	char **baseline = calloc(2*table->numApproaches, sizeof(char *));
+	
+	for (int a = 0; a < table->numApproaches; a++)
 	{
-		devset[j] = (statsInterval[j].cps-calcAverageCPS(statsInterval, sizeStats))*(statsInterval[j].cps-calcAverageCPS(statsInterval, sizeStats));
-		j++;
+		char upperName[16];
+		char path[200];
+		int c;
+		
+		for (c = 0; table->approaches[a].name[c] != 0 && c < 15; c++)
+		{
+			upperName[c] = toupper((unsigned char)table->approaches[a].name[c]);
+		}
+		upperName[c] = 0;
+		
+		snprintf(path, sizeof(path), "%s_%s_SIM.stat", prefix, upperName);
+		baseline[2*a] = readWholeFile(path);
+		snprintf(path, sizeof(path), "%s_%s_RAW.rawstat", prefix, upperName);
+		baseline[2*a + 1] = readWholeFile(path);
 	}
 	
-	j = 0;
-	while (j < sizeStats)
+	return baseline;
+}
+
+char *readWholeFile(const char *path)
+{
+	FILE *fptr = fopen(path, "rb");
+	
+	if (fptr == NULL)
 	{
-		popdev += devset[j];
-			
-		j++;
+		return NULL;
 	}
-	popdev = sqrt(popdev/sizeStats);
 	
-	if (sizeStats <= 0)
+	fseek(fptr, 0, SEEK_END);
+	long length = ftell(fptr);
+	fseek(fptr, 0, SEEK_SET);
+	
+	char *contents = malloc(length + 1);
+	contents[fread(contents, 1, length, fptr)] = 0;
+	fclose(fptr);
+	
+	return contents;
+}
+
+//two lines match when their text is the same and every number in them is within the replay tolerance
+bool numbersMatch(const char *baseline, const char *replay)
+{
+	while (*baseline != 0 || *replay != 0)
 	{
-		return -1;
+		char *baselineEnd;
+		char *replayEnd;
+		
+		if ((isdigit((unsigned char)*baseline) || *baseline == '-') && (isdigit((unsigned char)*replay) || *replay == '-'))
+		{
+			double a = strtod(baseline, &baselineEnd);
+			double b = strtod(replay, &replayEnd);
+			
+			if (baselineEnd != baseline && replayEnd != replay)
+			{
+				if (fabs(a - b) > replayTolerance*fmax(1, fmax(fabs(a), fabs(b))))
+				{
+					return false;
+				}
+				
+				baseline = baselineEnd;
+				replay = replayEnd;
+				continue;
+			}
+		}
+		
+		if (*baseline != *replay)
+		{
+			return false;
+		}
+		
+		baseline++;
+		replay++;
 	}
 	
-	return popdev;
+	return true;
 }
 
-float calcSmplStdDevCPS(struct StatsOverInterval statsInterval[ ], int sizeStats) 
+//compare a baseline file's contents with the replay's file line by line, listing the first differences
+int diffStatsFile(struct ReportBuffer *report, const char *name, char *baseline, const char *path)
 {
-	float devset[sizeStats];
-	int j = 0;
-	float smpldev = 0;
-	while (j < sizeStats)
+	char *replay = readWholeFile(path);
+	
+	if (baseline == NULL || replay == NULL)
 	{
-		devset[j] = (statsInterval[j].cps-calcAverageCPS(statsInterval, sizeStats))*(statsInterval[j].cps-calcAverageCPS(statsInterval, sizeStats));
-		j++;
+		reportPrintf(report, "%s: %s\r\n\r\n", name, baseline == NULL ? "missing from the baseline" : "missing from the replay");
+		free(replay);
+		return baseline != replay;	//both missing, e.g. raw text output off, is no difference
 	}
 	
-	j = 0;
-	while (j < sizeStats)
+	char *baselineNext = baseline;
+	char *replayNext = replay;
+	int line = 0;
+	int differences = 0;
+	
+	while (*baselineNext != 0 || *replayNext != 0)
 	{
-		smpldev += devset[j];
+		char *baselineLine = strsep(&baselineNext, "\n");
+		char *replayLine = strsep(&replayNext, "\n");
+		line++;
+		
+		baselineLine[strcspn(baselineLine, "\r")] = 0;
+		replayLine[strcspn(replayLine, "\r")] = 0;
+		
+		if (!numbersMatch(baselineLine, replayLine))
+		{
+			if (differences < replayDiffLines)
+			{
+				reportPrintf(report, "%s Line %d Baseline: %s\r\n", name, line, baselineLine);
+				reportPrintf(report, "%s Line %d Replay: %s\r\n", name, line, replayLine);
+			}
 			
-		j++;
+			differences++;
+		}
+		
+		if (baselineNext == NULL || replayNext == NULL)
+		{
+			//one file ended; the other's remaining lines all differ
+			for (char *rest = baselineNext != NULL ? baselineNext : replayNext; rest != NULL && *rest != 0; strsep(&rest, "\n"))
+			{
+				differences++;
+			}
+			
+			break;
+		}
 	}
 	
-	if (sizeStats == 1)
+	reportPrintf(report, "%s Differing Lines: %d\r\n\r\n", name, differences);
+	free(replay);
+	
+	return differences;
+}
+
+//diff the replay's stats files against the baseline's into *_DIFF.stat; returns the number of differing lines
+int writeReplayDiff(char filename[], const char *prefix, struct PhaseTable *table, char **baseline)
+{
+	struct ReportBuffer report = {NULL, 0, 0, -1, true, ""};
+	char fullFilename[200];
+	snprintf(fullFilename, sizeof(fullFilename), "%s_DIFF.stat", filename);
+	
+	int differences = 0;
+	
+	if (!reportOpen(&report, fullFilename, 1024 + (size_t)table->numApproaches*2*replayDiffLines*256))
 	{
+		free(report.data);
+		
+		for (int i = 0; i < 2*table->numApproaches; i++)
+		{
+			free(baseline[i]);
+		}
+		
+		free(baseline);
 		return -1;
 	}
-	else
+	
+	reportPrintf(&report, "Replay Compared with %s\r\nx--------x--------x-------x--------x\r\n\r\n", prefix);
+	
+	for (int a = 0; a < table->numApproaches; a++)
 	{
-		smpldev = sqrt(smpldev/(sizeStats-1));
+		char upperName[16];
+		char path[200];
+		char name[40];
+		int c;
+		
+		for (c = 0; table->approaches[a].name[c] != 0 && c < 15; c++)
+		{
+			upperName[c] = toupper((unsigned char)table->approaches[a].name[c]);
+		}
+		upperName[c] = 0;
+		
+		snprintf(path, sizeof(path), "%s_%s_SIM.stat", filename, upperName);
+		snprintf(name, sizeof(name), "%s SIM", upperName);
+		differences += diffStatsFile(&report, name, baseline[2*a], path);
+		
+		snprintf(path, sizeof(path), "%s_%s_RAW.rawstat", filename, upperName);
+		snprintf(name, sizeof(name), "%s RAW", upperName);
+		differences += diffStatsFile(&report, name, baseline[2*a + 1], path);
+		
+		free(baseline[2*a]);
+		free(baseline[2*a + 1]);
 	}
 	
-	return smpldev;
+	reportPrintf(&report, "Total Differing Lines: %d\r\n", differences);
+	reportClose(&report);
+	free(report.data);
+	free(baseline);
+	
+	writeToLog(date, logDegree, 23, (char *)prefix, differences);
+	
+	return differences;
 }
 
-float calcTimeSaved (struct StatsOverInterval statsInterval[ ], int sizeStats, const float defaultIntersectionTime)
+bool writeToLog(char filename[], int degreeLogging, int logMessageNumber, char tag[], float value)
 {
-	float total = 0;
-	for (int i = 0; i < sizeStats; i++)
+	//filter before doing any work
+	if (logMessageNumber < 0 || logMessageNumber >= 25 || degreeLogging <= logMessageDegree[logMessageNumber])
 	{
-		total += statsInterval[i].timeInterval;
+		return true;
+	}
+	
+	if (!logger.started && !startLogger(filename))
+	{
+		return false;
+	}
+	
+	LATENCY_START(start);
+	
+	//claim a slot; the sequence number says whether the writer has freed it yet
+	unsigned int position = atomic_load_explicit(&logger.head, memory_order_relaxed);
+	unsigned int slot;
+	
+	while (true)
+	{
+		slot = position % 1024;
+		unsigned int sequence = atomic_load_explicit(&logger.sequence[slot], memory_order_acquire);
+		int difference = (int)(sequence - position);
+		
+		if (difference == 0)
+		{
+			if (atomic_compare_exchange_weak_explicit(&logger.head, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (difference < 0 && logger.lossless)
+		{
+			usleep(100);	//ring full; let the writer catch up
+			position = atomic_load_explicit(&logger.head, memory_order_relaxed);
+		}
+		else if (difference < 0)
+		{
+			atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);	//ring full
+			return false;
+		}
+		else
+		{
+			position = atomic_load_explicit(&logger.head, memory_order_relaxed);
+		}
 	}
-	return (sizeStats*defaultIntersectionTime - total);
-}
-
-struct StatsOverSimulation computeStatsOverSimulation(struct StatsOverInterval intervalStats[], int sizeStats)
-{
-	char funcTag[] = "StatsOverSimulation";
-	writeToLog(date, logDegree, 9, funcTag, 0);
 	
-	struct StatsOverSimulation statsSim;
-	statsSim.totalCars = calcTotalCars(intervalStats, sizeStats);
-	statsSim.totalTime = calcTotalTime(intervalStats, sizeStats);
-	statsSim.maxCars = calcMaxCars(intervalStats, sizeStats);
-	statsSim.minCars = calcMinCars(intervalStats, sizeStats);
-	statsSim.averageCars = calcAvgCars (intervalStats, sizeStats);
-	statsSim.averageTime = calcAvgTime (intervalStats, sizeStats);
-	statsSim.numModes = calcModeCars(intervalStats, sizeStats, statsSim.modeCars);
-	statsSim.maxCPS = calcMaxCPS(intervalStats, sizeStats);
-	statsSim.minCPS = calcMinCPS(intervalStats, sizeStats);
-	statsSim.avgCPS = calcAverageCPS(intervalStats, sizeStats);
-	statsSim.medianCPS = calcMedianCPS(intervalStats, sizeStats);
-	statsSim.popStdDevCPS = calcPopStdDevCPS(intervalStats, sizeStats);
-	statsSim.smplStdDevCPS = calcSmplStdDevCPS(intervalStats, sizeStats);
-	statsSim.timeSaved = calcTimeSaved(intervalStats, sizeStats, 30);
+	struct LogRecord *record = &logger.records[slot];
+	record->logMessageNumber = logMessageNumber;
+	record->value = value;
+	record->tag[0] = 0;
 	
-	writeToLog(date, logDegree, 10, funcTag, 0);
-	return statsSim;
+	if (tag != NULL)
+	{
+		strncpy(record->tag, tag, sizeof(record->tag) - 1);
+		record->tag[sizeof(record->tag) - 1] = 0;
+	}
 	
+	atomic_store_explicit(&logger.sequence[slot], position + 1, memory_order_release);
+	LATENCY_RECORD(LATENCY_LOG_ENQUEUE, start);
+	
+	return true;
 }
 
-bool writeStatsToFile (char filename[], struct StatsOverInterval statsIntervalNorth[], int sizeNorth, 
-						struct StatsOverInterval statsIntervalWest[], int sizeWest, 
-						struct StatsOverSimulation statsSimNorth, struct StatsOverSimulation statsSimWest)
+bool startLogger(char filename[])
 {
-	char funcTag[] = "writeStatsToFile";
-	writeToLog(date, logDegree, 9, funcTag, 0);
+	char logName[strlen(filename)+5];
 	
-	FILE* fptr;
+	strcpy(logName, filename);
+	strcat(logName, ".log");
 	
-	//North Raw Data
-	char fullFilenameRawNorth[100];
-	strcpy(fullFilenameRawNorth, filename);
-	char extensionRawNorth[] = "_NORTH_RAW.rawstat";
-	strcat(fullFilenameRawNorth, extensionRawNorth);
+	logger.file = fopen(logName, "a");
 	
-	fptr = fopen(fullFilenameRawNorth, "w");
-	fprintf(fptr, "Raw Data for North Direction\r\nx--------x--------x-------x--------x\r\n\r\n");
-	for (int i = 0; i < sizeNorth; i++)
+	if (logger.file == NULL)
 	{
-		fprintf(fptr, "Time Interval #%d: \r\nNumber of Cars: %d\r\nTime Interval Length: %f s\r\nCars Per Second: %f cps\r\n\r\n", i+1, statsIntervalNorth[i].numCars, statsIntervalNorth[i].timeInterval, statsIntervalNorth[i].cps);
+		return false;
 	}
-	writeToLog(date, logDegree, 11, fullFilenameRawNorth, 0);
-	fclose(fptr);
 	
-	//West Raw Data
-	char fullFilenameRawWest[100];
-	strcpy(fullFilenameRawWest, filename);
-	char extensionRawWest[] = "_WEST_RAW.rawstat";
-	strcat(fullFilenameRawWest, extensionRawWest);
+	setvbuf(logger.file, NULL, _IOFBF, 16384);
 	
-	fptr = fopen(fullFilenameRawWest, "w");
-	fprintf(fptr, "Raw Data for West Direction\r\nx--------x--------x-------x--------x\r\n\r\n");
-	for (int i = 0; i < sizeWest; i++)
+	for (unsigned int i = 0; i < 1024; i++)
 	{
-		fprintf(fptr, "Time Interval #%d: \r\nNumber of Cars: %d\r\nTime Interval Length: %f s\r\nCars Per Second: %f cps\r\n\r\n", i+1, statsIntervalWest[i].numCars, statsIntervalWest[i].timeInterval, statsIntervalWest[i].cps);
+		atomic_init(&logger.sequence[i], i);
 	}
-	writeToLog(date, logDegree, 11, fullFilenameRawWest, 0);
-	fclose(fptr);
-	
-	//North Simulation Stats
-	char fullFilenameStatNorth[100];
-	strcpy(fullFilenameStatNorth, filename);
-	char extensionStatNorth[] = "_NORTH_SIM.stat";
-	strcat(fullFilenameStatNorth, extensionStatNorth);
-	
-	fptr = fopen(fullFilenameStatNorth, "w");
-	fprintf(fptr, "Simulation Statistics for North Direction\r\nx--------x--------x-------x--------x\r\n\r\n");
-	fprintf(fptr, "Total Cars: %d\r\n", statsSimNorth.totalCars);
-	fprintf(fptr, "Total Time: %f s\r\n", statsSimNorth.totalTime);
-	fprintf(fptr, "Max Cars: %d\r\n", statsSimNorth.maxCars);
-	fprintf(fptr, "Min Cars: %d\r\n", statsSimNorth.minCars);
-	fprintf(fptr, "Average Cars: %f\r\n", statsSimNorth.averageCars);
-	fprintf(fptr, "Average Time: %f s\r\n", statsSimNorth.averageTime);
-	fprintf(fptr, "Mode(s) # of Cars: ");
-	for (int i = 0; i < statsSimNorth.numModes; i++)
-	{
-		fprintf(fptr, "%d, ", statsSimNorth.modeCars[i]);
-	}
-	fprintf(fptr, "\r\n");
-	fprintf(fptr, "Maximum Cars Per Second: %f cps\r\n", statsSimNorth.maxCPS);
-	fprintf(fptr, "Minimim Cars Per Second: %f cps\r\n", statsSimNorth.minCPS);
-	fprintf(fptr, "Average Cars Per Second: %f cps\r\n", statsSimNorth.avgCPS);
-	fprintf(fptr, "Median Cars Per Second: %f cps\r\n", statsSimNorth.medianCPS);;
-	fprintf(fptr, "Population Standard Deviation Cars Per Second: %f cps\r\n", statsSimNorth.popStdDevCPS);
-	fprintf(fptr, "Sample Standard Deviation Cars Per Second: %f cps\r\n", statsSimNorth.smplStdDevCPS);
-	fprintf(fptr, "Time Saved: %f s\r\n\r\n", statsSimNorth.timeSaved);
-	
-	fprintf(fptr, "         _______\r\n       //  ||  \\\\\r\n _____//___||__\\ \\___\r\n )  _    HIIIII-5 _    \\\r\n |_/  \\_________ /  \\___|\r\n___ \\_/_________ \\_/______\r\n");
-	
-	writeToLog(date, logDegree, 11, fullFilenameStatNorth, 0);
-	fclose(fptr);
+	atomic_init(&logger.head, 0);
+	atomic_init(&logger.dropped, 0);
+	atomic_init(&logger.running, true);
+	logger.tail = 0;
+	logger.started = true;
 	
-	//West Simulation Stats
-	char fullFilenameStatWest[100];
-	strcpy(fullFilenameStatWest, filename);
-	char extensionStatWest[] = "_WEST_SIM.stat";
-	strcat(fullFilenameStatWest, extensionStatWest);
-	
-	fptr = fopen(fullFilenameStatWest, "w");
-	fprintf(fptr, "Simulation Statistics for West Direction\r\nx--------x--------x-------x--------x\r\n\r\n");
-	fprintf(fptr, "Total Cars: %d\r\n", statsSimWest.totalCars);
-	fprintf(fptr, "Total Time: %f s\r\n", statsSimWest.totalTime);
-	fprintf(fptr, "Max Cars: %d\r\n", statsSimWest.maxCars);
-	fprintf(fptr, "Min Cars: %d\r\n", statsSimWest.minCars);
-	fprintf(fptr, "Average Cars: %f\r\n", statsSimWest.averageCars);
-	fprintf(fptr, "Average Time: %f s\r\n", statsSimWest.averageTime);
-	fprintf(fptr, "Mode(s) # of Cars: ");
-	for (int i = 0; i < statsSimWest.numModes; i++)
-	{
-		fprintf(fptr, "%d, ", statsSimWest.modeCars[i]);
-	}
-	fprintf(fptr, "\r\n");
-	fprintf(fptr, "Maximum Cars Per Second: %f cps\r\n", statsSimWest.maxCPS);
-	fprintf(fptr, "Minimim Cars Per Second: %f cps\r\n", statsSimWest.minCPS);
-	fprintf(fptr, "Average Cars Per Second: %f cps\r\n", statsSimWest.avgCPS);
-	fprintf(fptr, "Median Cars Per Second: %f cps\r\n", statsSimWest.medianCPS);;
-	fprintf(fptr, "Population Standard Deviation Cars Per Second: %f cps\r\n", statsSimWest.popStdDevCPS);
-	fprintf(fptr, "Sample Standard Deviation Cars Per Second: %f cps\r\n", statsSimWest.smplStdDevCPS);
-	fprintf(fptr, "Time Saved: %f s\r\n\r\n", statsSimWest.timeSaved);
-	
-	fprintf(fptr, "         _______\r\n       //  ||  \\\\\r\n _____//___||__\\ \\___\r\n )  _    HIIIII-5 _    \\\r\n |_/  \\_________ /  \\___|\r\n___ \\_/_________ \\_/______\r\n");
-	
-	writeToLog(date, logDegree, 11, fullFilenameStatWest, 0);
-	fclose(fptr);
+	pthread_create(&logger.thread, NULL, logWriter, NULL);
 	
-	writeToLog(date, logDegree, 10, funcTag, 0);
 	return true;
-	
 }
 
-bool writeToLog(char filename[], int degreeLogging, int logMessageNumber, char tag[], float value)
+void stopLogger()
 {
-	int nameLength = 0;
-	
-	while(filename[nameLength] != 0)
+	if (!logger.started)
 	{
-		nameLength++;
+		return;
 	}
 	
-	char logName[nameLength+5];
-	char extension[] = ".log";
+	//the writer drains whatever is left before exiting
+	atomic_store(&logger.running, false);
+	pthread_join(logger.thread, NULL);
 	
-	strcpy(logName, filename);
-	strcat(logName, extension);
-	
-	FILE* fptr;
+	unsigned long dropped = atomic_load(&logger.dropped);
 	
-	fptr = fopen(logName, "a");
+	if (dropped > 0)
+	{
+		fprintf(logger.file, "Dropped %lu log messages.\r\n", dropped);
+	}
 	
-	switch(logMessageNumber)
+	fclose(logger.file);
+	logger.started = false;
+}
+
+void *logWriter(void *arg)
+{
+	while (true)
 	{
-		case 0:
+		bool running = atomic_load(&logger.running);
+		int written = 0;
+		LATENCY_START(start);
 		
-			if(degreeLogging > 0)
+		//write out everything published so far as one batch
+		while (true)
+		{
+			unsigned int slot = logger.tail % 1024;
+			
+			if (atomic_load_explicit(&logger.sequence[slot], memory_order_acquire) != logger.tail + 1)
 			{
-				fprintf(fptr, "Welcome to the log file!\r\n");
+				break;
 			}
 			
+			formatLogRecord(logger.file, &logger.records[slot]);
+			atomic_store_explicit(&logger.sequence[slot], logger.tail + 1024, memory_order_release);
+			logger.tail++;
+			written++;
+		}
+		
+		if (written > 0)
+		{
+			fflush(logger.file);
+			LATENCY_RECORD(LATENCY_LOG_WRITE, start);
+		}
+		else if (!running)
+		{
+			break;
+		}
+		else
+		{
+			usleep(20000);
+		}
+	}
+	
+	return NULL;
+}
+
+void formatLogRecord(FILE *fptr, struct LogRecord *record)
+{
+	switch(record->logMessageNumber)
+	{
+		case 0:
+		
+			fprintf(fptr, "Welcome to the log file!\r\n");
+			
 			break;
 			
 		case 1:
 			
-			if(degreeLogging > 0)
-			{
-				fprintf(fptr, "Sensor at port: %f.\r\n", value);
-			}
+			fprintf(fptr, "Sensor at port: %f.\r\n", record->value);
 			
 			break;
 		
 		case 2:
 		
-			if(degreeLogging > 0)
-			{
-				fprintf(fptr, "Red light at port: %f.\r\n", value);
-			}
+			fprintf(fptr, "Red light at port: %f.\r\n", record->value);
 			
 			break;
 			
 		case 3:
 			
-			if(degreeLogging > 0)
-			{
-				fprintf(fptr, "Green light at port: %f.\r\n", value);
-			}
+			fprintf(fptr, "Green light at port: %f.\r\n", record->value);
 			
 			break;
 			
 		case 4:
 		
-			if(degreeLogging > 5)
-			{
-				fprintf(fptr, "Time Saved: %f seconds, Tag: %s.\r\n", value, tag); 
-			}
+			fprintf(fptr, "Time Saved: %f seconds, Tag: %s.\r\n", record->value, record->tag);
 			
 			break;
 			
 		case 5:
 		
-			if(degreeLogging > 5)
-			{
-				fprintf(fptr, "Time interval for green light: %f seconds, Tag: %s.\r\n", value, tag);
-			}
+			fprintf(fptr, "Time interval for green light: %f seconds, Tag: %s.\r\n", record->value, record->tag);
 			
 			break;
 			
 		case 6:
 		
-			if(degreeLogging > 5)
-			{
-				fprintf(fptr, "Cars per second during 1 green light: %f, Tag: %s.\r\n", value, tag);
-			}
+			fprintf(fptr, "Cars per second during 1 green light: %f, Tag: %s.\r\n", record->value, record->tag);
 			
 			break;
 			
 		case 7:
 		
-			if(degreeLogging > 9)
-			{
-				fprintf(fptr, "Sensor value: %f, Tag: %s.\r\n", value, tag);
-			}
+			fprintf(fptr, "Sensor value: %f, Tag: %s.\r\n", record->value, record->tag);
 			
 			break;
 			
 		case 8:
 		
-			if(degreeLogging > 9)
-			{
-				fprintf(fptr, "Car passed.\r\n");
-			}
+			fprintf(fptr, "Car passed.\r\n");
 			
 			break;
 			
 		case 9:
 		
-			if(degreeLogging > 0)
-			{
-				fprintf(fptr, "Currently in function %s.\r\n", tag);
-			}
+			fprintf(fptr, "Currently in function %s.\r\n", record->tag);
 			
 			break;
 			
 		case 10:
 		
-			if(degreeLogging > 0)
-			{
-				fprintf(fptr, "Exiting function %s.\r\n", tag);
-			}
+			fprintf(fptr, "Exiting function %s.\r\n", record->tag);
 			
 			break;
 			
 		case 11:
 		
-			if(degreeLogging > 0)
-			{
-				fprintf(fptr, "Successfully written statistics file %s.\r\n", tag);
-			}
+			fprintf(fptr, "Successfully written statistics file %s.\r\n", record->tag);
 			
 			break;
 			
 		case 12:
 		
-			if(degreeLogging > 0)
-			{
-				fprintf(fptr, "Simulation Terminated.\r\n");
-			}
+			fprintf(fptr, "Simulation Terminated.\r\n");
 			
 			break;
 			
 		case 13:
 		
-			if(degreeLogging > 0)
-			{
-				fprintf(fptr, "Value of %s: %f\r\n", tag, value);
-			}
+			fprintf(fptr, "Value of %s: %f\r\n", record->tag, record->value);
 			
 			break;
 			
 		case 14:
 		
-			if(degreeLogging > 5)
+			fprintf(fptr, "Number of cars in interval: %f, Tag: %s.\r\n", record->value, record->tag);
+			
+			break;
+			
+		case 15:
+		
+			fprintf(fptr, "Interval storage full at %f intervals, raw data no longer kept, Tag: %s.\r\n", record->value, record->tag);
+			
+			break;
+			
+		case 16:
+		
+			fprintf(fptr, "Cars detected waiting on red: %f, Tag: %s.\r\n", record->value, record->tag);
+			
+			break;
+			
+		case 17:
+		
+			fprintf(fptr, "Car left the sensor after %f seconds, Tag: %s.\r\n", record->value, record->tag);
+			
+			break;
+			
+		case 18:
+		
+			fprintf(fptr, "Intervals recovered from the journal: %f, Tag: %s.\r\n", record->value, record->tag);
+			
+			break;
+			
+		case 19:
+		
+			fprintf(fptr, "Output continues in the files of %s.\r\n", record->tag);
+			
+			break;
+			
+		case 20:
+		
+			fprintf(fptr, "Raw samples traced: %f, Tag: %s.\r\n", record->value, record->tag);
+			
+			break;
+			
+		case 21:
+		
+			fprintf(fptr, "Raw samples dropped from the trace: %f, Tag: %s.\r\n", record->value, record->tag);
+			
+			break;
+			
+		case 22:
+		
+			fprintf(fptr, "Sensor readings replayed: %f, Tag: %s.\r\n", record->value, record->tag);
+			
+			break;
+			
+		case 23:
+		
+			fprintf(fptr, "Lines differing from the baseline: %f, Tag: %s.\r\n", record->value, record->tag);
+			
+			break;
+			
+		case 24:
+		
+			fprintf(fptr, "Light write failed with errno: %f, Tag: %s.\r\n", record->value, record->tag);
+			
+			break;
+	}
+}
+
+#ifdef TRAFFIC_BENCH
+//Benchmarks for the statistics, output, logging and sensor paths, built with -DTRAFFIC_BENCH
+//(plus -DTRAFFIC_SIM_ONLY off the Omega). Usage: traffic [max intervals, default 1000000]
+//Output is CSV on stdout: benchmark,size,iterations,total_ns,ns_per_op
+//Files the benchmarks write go to a scratch directory under $TMPDIR that is removed afterwards.
+//calc* and computeStatsOverSimulation report ns per pass over the whole run, writeToLog and readSensor ns per call.
+
+const long long benchWorkPerCase = 10000000;	//intervals processed per benchmark case, spread over its iterations
+const long long mockEchoDelay = 450000;			//ns from the trigger falling to the echo rising on an HC-SR04
+const long long mockPinReadCost = 50;			//ns a sysfs pin read or clock read costs, charged to the virtual clock
+const float mockRange = 120;					//cm the mocked sensor reports
+
+int runBenchmarks(int argc, char **argv)
+{
+	int maxSize = argc > 1 ? atoi(argv[1]) : 1000000;
+	volatile double sink = 0;	//keeps results alive so the compiler can't drop the calls
+	
+	//scratch directory for the files the output and logging benchmarks write
+	const char *tmp = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+	char scratch[64];
+	snprintf(scratch, sizeof(scratch), "%s/trafficbench.XXXXXX", tmp);
+	
+	if (mkdtemp(scratch) == NULL)
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+	
+	snprintf(date, sizeof(date), "%s/bench", scratch);
+	logDegree = 0;
+	backend = createMockBackend(false);
+	
+	printf("benchmark,size,iterations,total_ns,ns_per_op\n");
+	
+	for (int size = 100; size <= maxSize; size *= 10)
+	{
+		struct StatsOverInterval *intervals = malloc(size*sizeof(struct StatsOverInterval));
+		int *modes = malloc(size*sizeof(int));
+		int iterations = benchWorkPerCase/size > 0 ? benchWorkPerCase/size : 1;
+		long long start;
+		
+		benchIntervals(intervals, size);
+		
+		//each calc* function over the whole run
+		const char *calcNames[] = {"calcCarsPerSecond", "calcTotalCars", "calcTotalTime", "calcMaxCars", "calcMinCars", "calcAvgCars", "calcAvgTime", "calcModeCars", "calcMaxCPS", "calcMinCPS", "calcAverageCPS", "calcMedianCPS", "calcPopStdDevCPS", "calcSmplStdDevCPS", "calcTimeSaved"};
+		
+		for (int f = 0; f < 15; f++)
+		{
+			start = benchNow();
+			
+			for (int n = 0; n < iterations; n++)
 			{
-				fprintf(fptr, "Number of cars in interval: %f, Tag: %s.\r\n", value, tag);
+				switch (f)
+				{
+					case 0:
+						for (int i = 0; i < size; i++)
+						{
+							sink += calcCarsPerSecond(intervals[i]);
+						}
+						break;
+					case 1: sink += calcTotalCars(intervals, size); break;
+					case 2: sink += calcTotalTime(intervals, size); break;
+					case 3: sink += calcMaxCars(intervals, size); break;
+					case 4: sink += calcMinCars(intervals, size); break;
+					case 5: sink += calcAvgCars(intervals, size); break;
+					case 6: sink += calcAvgTime(intervals, size); break;
+					case 7: sink += calcModeCars(intervals, size, modes); break;
+					case 8: sink += calcMaxCPS(intervals, size); break;
+					case 9: sink += calcMinCPS(intervals, size); break;
+					case 10: sink += calcAverageCPS(intervals, size); break;
+					case 11: sink += calcMedianCPS(intervals, size); break;
+					case 12: sink += calcPopStdDevCPS(intervals, size); break;
+					case 13: sink += calcSmplStdDevCPS(intervals, size); break;
+					case 14: sink += calcTimeSaved(intervals, size, baselineGreenTime); break;
+				}
 			}
 			
-			break;
+			benchReport(calcNames[f], size, iterations, benchNow() - start);
+		}
+		
+		start = benchNow();
+		
+		for (int n = 0; n < iterations; n++)
+		{
+			struct StatsOverSimulation statsSim = computeStatsOverSimulation(intervals, size);
+			sink += statsSim.avgCPS;
+			freeStatsOverSimulation(&statsSim);
+		}
+		
+		benchReport("computeStatsOverSimulation", size, iterations, benchNow() - start);
+		
+		//writeStatsToFile with one approach holding the whole run; the files dominate, so fewer passes
+		struct Approach approach;
+		memset(&approach, 0, sizeof(approach));
+		strcpy(approach.name, "North");
+		initIntervalStore(&approach.intervals, 0, NULL);
+		
+		for (int i = 0; i < size; i++)
+		{
+			intervalStorePush(&approach.intervals, intervals[i]);
+		}
+		
+		struct StatsOverSimulation statsSim = computeStatsOverSimulation(intervals, size);
+		int fileIterations = iterations/100 > 0 ? iterations/100 : 1;
+		
+		start = benchNow();
+		
+		for (int n = 0; n < fileIterations; n++)
+		{
+			writeStatsToFile(date, &approach, 1, &statsSim);
+		}
+		
+		benchReport("writeStatsToFile", size, fileIterations, benchNow() - start);
+		
+		freeStatsOverSimulation(&statsSim);
+		freeIntervalStore(&approach.intervals);
+		
+		//writeToLog: a message below the degree is filtered, one above it goes through the logger
+		char tag[] = "North";
+		
+		start = benchNow();
+		
+		for (int i = 0; i < size; i++)
+		{
+			writeToLog(date, 0, 5, tag, TIME_TO_SECONDS(intervals[i].timeInterval));
+		}
+		
+		benchReport("writeToLog_filtered", size, size, benchNow() - start);
+		
+		logger.lossless = true;
+		start = benchNow();
+		
+		for (int i = 0; i < size; i++)
+		{
+			writeToLog(date, 10, 5, tag, TIME_TO_SECONDS(intervals[i].timeInterval));
+		}
+		
+		stopLogger();
+		benchReport("writeToLog", size, size, benchNow() - start);
+		
+		free(modes);
+		free(intervals);
+	}
+	
+	//readSensor against the mocked echo pin, polling and with edge timestamps
+	for (int edges = 0; edges < 2; edges++)
+	{
+		free(backend->state);
+		free(backend);
+		backend = createMockBackend(edges);
+		
+		int reads = maxSize < 10000 ? maxSize : 10000;
+		long long start = benchNow();
+		
+		for (int i = 0; i < reads; i++)
+		{
+			sink += readSensor(SENS_N_IN, SENS_N_OUT);
+		}
+		
+		benchReport(edges ? "readSensor_edge" : "readSensor_poll", 1, reads, benchNow() - start);
 	}
+	
+	//detector filtering a trace of a car every 50 readings, a block at a time
+	{
+		struct Detector detector;
+		struct RangeSample samples[DETECTOR_BLOCK];
+		struct VehicleEvent events[DETECTOR_BLOCK];
+		
+		initDetector(&detector, defaultThreshold);
+		
+		long long start = benchNow();
+		
+		for (int i = 0; i < maxSize; i += DETECTOR_BLOCK)
+		{
+			for (int j = 0; j < DETECTOR_BLOCK; j++)
+			{
+				samples[j].timestamp = (i + j)*100000000LL;
+				samples[j].range = (i + j) % 50 < 3 ? RANGE_FROM_CM(0.1) : RANGE_FROM_CM(250);
+			}
 			
-	fclose(fptr);
+			sink += detectorProcess(&detector, samples, DETECTOR_BLOCK, events);
+		}
+		
+		benchReport("detectorProcess", DETECTOR_BLOCK, maxSize/DETECTOR_BLOCK*DETECTOR_BLOCK, benchNow() - start);
+	}
+	
+	free(backend->state);
+	free(backend);
+	
+	//clean up the scratch files
+	const char *suffixes[] = {"_NORTH_RAW.rawstat", "_NORTH_RAW.rawbin", "_NORTH_SIM.stat", ".log"};
+	
+	for (int i = 0; i < 4; i++)
+	{
+		char path[128];
+		snprintf(path, sizeof(path), "%s%s", date, suffixes[i]);
+		unlink(path);
+	}
+	
+	rmdir(scratch);
+	
+	return sink != sink;	//NaN would mean a broken calc function
+}
+
+long long benchNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+void benchReport(const char *name, int size, int iterations, long long elapsed)
+{
+	printf("%s,%d,%d,%lld,%.1f\n", name, size, iterations, elapsed, (double)elapsed/iterations);
+	fflush(stdout);
+}
+
+//a repeatable run shaped like real traffic: 0-15 cars in 5-30 s intervals
+void benchIntervals(struct StatsOverInterval intervals[], int size)
+{
+	unsigned int seed = 1;
+	
+	for (int i = 0; i < size; i++)
+	{
+		intervals[i].numCars = rand_r(&seed) % 16;
+		intervals[i].timeInterval = TIME_FROM_SECONDS(5 + rand_r(&seed) % 26);
+		intervals[i].startTime = i*30000000000LL;
+		intervals[i].cps = calcCarsPerSecond(intervals[i]);
+	}
+}
+
+struct Backend *createMockBackend(bool edges)
+{
+	struct Backend *mock = calloc(1, sizeof(struct Backend));
+	struct MockState *state = calloc(1, sizeof(struct MockState));
+	
+	state->echoRise = LLONG_MAX;
+	state->echoFall = LLONG_MAX;
+	state->range = mockRange;
+	
+	mock->name = "mock";
+	mock->state = state;
+	mock->virtualTime = true;
+	mock->requestPin = simRequestPin;	//pins need no setup
+	mock->setValue = mockSetValue;
+	mock->getValue = mockGetValue;
+	mock->now = mockNow;
+	mock->sleepMicro = mockSleepMicro;
+	
+	if (edges)
+	{
+		mock->armEdge = mockArmEdge;
+		mock->waitEdge = mockWaitEdge;
+	}
+	
+	return mock;
+}
+
+void mockSetValue(struct Backend *self, const unsigned int port, int value)
+{
+	struct MockState *state = self->state;
+	
+	//the echo pulse starts once the trigger falls
+	if (value == 0)
+	{
+		state->echoRise = state->clock + mockEchoDelay;
+		state->echoFall = state->echoRise + llroundf(state->range*58*1000);
+	}
+}
+
+int mockGetValue(struct Backend *self, const unsigned int port)
+{
+	struct MockState *state = self->state;
+	
+	state->clock += mockPinReadCost;
+	
+	return state->clock >= state->echoRise && state->clock < state->echoFall;
+}
+
+long long mockNow(struct Backend *self)
+{
+	struct MockState *state = self->state;
 	
+	state->clock += mockPinReadCost;
+	
+	return state->clock;
+}
+
+void mockSleepMicro(struct Backend *self, unsigned int microseconds)
+{
+	struct MockState *state = self->state;
+	
+	state->clock += microseconds*1000LL;
+}
+
+bool mockArmEdge(struct Backend *self, const unsigned int port)
+{
 	return true;
 }
 
+bool mockWaitEdge(struct Backend *self, const unsigned int port, int level, long long timeout, long long *timestamp)
+{
+	struct MockState *state = self->state;
+	long long edge = level ? state->echoRise : state->echoFall;
+	
+	if (edge - state->clock > timeout)
+	{
+		return false;
+	}
+	
+	state->clock = edge;
+	*timestamp = edge;
+	
+	return true;
+}
+#endif